@@ -0,0 +1,718 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Headless benchmarks for the processing chain, the filter designs and the
+    analyzer's FFT, and the editor's open time. One JSON object per line, so
+    two runs can be compared.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PluginEditor.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+
+/*
+ every result is the best of a few runs: the minimum is what the code costs, anything
+ above it is the machine doing something else, which is noise when comparing commits.
+
+ cycles are estimated by timing a chain of dependent adds, which retire one per cycle
+ on anything we run on, so they follow whatever clock the core happens to be running
+ at. with another compiler they're left out.
+ */
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedNanoseconds(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    double measureCyclesPerNanosecond()
+    {
+       #if defined(__GNUC__) || defined(__clang__)
+        constexpr std::uint64_t numAdds = 200000000;
+        double best = 0.0;
+
+        for( int run = 0; run < 3; ++run )
+        {
+            std::uint64_t x = 0;
+            const auto start = Clock::now();
+
+            for( std::uint64_t i = 0; i < numAdds; ++i )
+            {
+                x += i;
+                asm volatile("" : "+r"(x));
+            }
+
+            best = juce::jmax(best, double(numAdds) / elapsedNanoseconds(start));
+        }
+
+        return best;
+       #else
+        return 0.0;
+       #endif
+    }
+
+    /*
+     the fastest of numRuns calls to run(), which returns the nanoseconds it measured.
+     */
+    template<typename Run>
+    double bestOf(int numRuns, Run&& run)
+    {
+        auto best = std::numeric_limits<double>::max();
+
+        for( int i = 0; i < numRuns; ++i )
+            best = juce::jmin(best, run());
+
+        return best;
+    }
+
+    //==============================================================================
+    struct Report
+    {
+        double cyclesPerNanosecond = 0.0;
+        juce::Array<juce::var> results;
+
+        /*
+         'fields' say what was measured, nanoseconds is the cost per 'unit' (sample or call).
+         */
+        void add(const juce::String& name, juce::NamedValueSet fields, const juce::String& unit, double nanoseconds)
+        {
+            auto* result = new juce::DynamicObject();
+            result->setProperty("name", name);
+
+            for( auto& field : fields )
+                result->setProperty(field.name, field.value);
+
+            result->setProperty("nsPer" + unit, nanoseconds);
+
+            if( cyclesPerNanosecond > 0.0 )
+                result->setProperty("cyclesPer" + unit, nanoseconds * cyclesPerNanosecond);
+
+            results.add(juce::var(result));
+
+            //progress goes to stderr, stdout is only the results
+            std::cerr << juce::JSON::toString(results.getReference(results.size() - 1), true) << std::endl;
+        }
+    };
+
+    /*
+     what identifies a result across runs: everything but the measurements.
+     */
+    juce::String getKey(const juce::var& result)
+    {
+        juce::String key;
+
+        if( auto* object = result.getDynamicObject() )
+            for( auto& property : object->getProperties() )
+                if( ! property.name.toString().startsWith("nsPer") && ! property.name.toString().startsWith("cyclesPer") )
+                    key << property.name.toString() << "=" << property.value.toString() << ";";
+
+        return key;
+    }
+
+    double getNanoseconds(const juce::var& result)
+    {
+        if( result.hasProperty("nsPerSample") )
+            return result["nsPerSample"];
+
+        return result["nsPerCall"];
+    }
+
+    //==============================================================================
+    const int slopeDecibels[] { 12, 24, 36, 48 };
+
+    void setParameter(JhanEQAudioProcessor& processor, const juce::String& id, float value)
+    {
+        auto* parameter = processor.apvts.getParameter(id);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    /*
+     processBlock for every block size, slope combination and sample rate, through one long
+     stretch of noise that's cut into blocks the way a host would hand them over.
+     */
+    void benchmarkProcessBlock(Report& report, const juce::Array<double>& sampleRates, const juce::Array<int>& blockSizes,
+                               int numSamples, int numRuns)
+    {
+        JhanEQAudioProcessor processor;
+
+        //a peak that does something, pass filters inside the audio band
+        setParameter(processor, "Peak Freq", 1000.f);
+        setParameter(processor, "Peak Gain", 6.f);
+        setParameter(processor, "Peak Quality", 1.f);
+        setParameter(processor, "HighPass Freq", 40.f);
+        setParameter(processor, "LowPass Freq", 16000.f);
+
+        juce::Random random(1);
+        juce::AudioBuffer<float> noise(2, numSamples), buffer(2, numSamples);
+
+        for( int channel = 0; channel < 2; ++channel )
+            for( int i = 0; i < numSamples; ++i )
+                noise.setSample(channel, i, random.nextFloat() * 2.f - 1.f);
+
+        juce::MidiBuffer midi;
+
+        for( auto sampleRate : sampleRates )
+        {
+            processor.setRateAndBufferSizeDetails(sampleRate, blockSizes.getLast());
+            processor.prepareToPlay(sampleRate, blockSizes.getLast());
+
+            for( int highPass = 0; highPass < 4; ++highPass )
+            {
+                for( int lowPass = 0; lowPass < 4; ++lowPass )
+                {
+                    setParameter(processor, "HighPass Slope", (float)highPass);
+                    setParameter(processor, "LowPass Slope", (float)lowPass);
+
+                    for( auto blockSize : blockSizes )
+                    {
+                        auto run = [&]
+                        {
+                            for( int channel = 0; channel < 2; ++channel )
+                                buffer.copyFrom(channel, 0, noise, channel, 0, numSamples);
+
+                            const auto start = Clock::now();
+
+                            for( int position = 0; position + blockSize <= numSamples; position += blockSize )
+                            {
+                                //refers to the samples in place, like a host's buffer would
+                                juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), 2, position, blockSize);
+                                processor.processBlock(block, midi);
+                            }
+
+                            return elapsedNanoseconds(start) / double(numSamples / blockSize * blockSize);
+                        };
+
+                        //the first run designs the filters for the new slopes
+                        run();
+
+                        juce::NamedValueSet fields;
+                        fields.set("sampleRate", sampleRate);
+                        fields.set("blockSize", blockSize);
+                        fields.set("highPassSlope", slopeDecibels[highPass]);
+                        fields.set("lowPassSlope", slopeDecibels[lowPass]);
+
+                        report.add("processBlock", fields, "Sample", bestOf(numRuns, run));
+                    }
+                }
+            }
+
+            processor.releaseResources();
+        }
+    }
+
+    /*
+     the fixed cost of a processBlock call, through empty blocks: updateFilters, the morph,
+     the tap and meter checks and updateAutoGain, with no samples to filter. once with
+     nothing changed and once with the peak gain moving before every block (a redesign and
+     a new auto gain, as under automation).
+     */
+    void benchmarkEmptyBlocks(Report& report, const juce::Array<double>& sampleRates, int numCalls, int numRuns)
+    {
+        JhanEQAudioProcessor processor;
+        setParameter(processor, "HighPass Slope", 3.f);
+        setParameter(processor, "LowPass Slope", 3.f);
+
+        juce::AudioBuffer<float> empty(2, 0);
+        juce::MidiBuffer midi;
+
+        for( auto sampleRate : sampleRates )
+        {
+            processor.setRateAndBufferSizeDetails(sampleRate, 512);
+            processor.prepareToPlay(sampleRate, 512);
+
+            juce::NamedValueSet fields;
+            fields.set("sampleRate", sampleRate);
+
+            report.add("processBlock/empty/unchanged", fields, "Call", bestOf(numRuns, [&]
+            {
+                const auto start = Clock::now();
+
+                for( int i = 0; i < numCalls; ++i )
+                    processor.processBlock(empty, midi);
+
+                return elapsedNanoseconds(start) / numCalls;
+            }));
+
+            report.add("processBlock/empty/changed", fields, "Call", bestOf(numRuns, [&]
+            {
+                //only the block is timed, not the parameter change in front of it
+                double total = 0.0;
+
+                for( int i = 0; i < numCalls; ++i )
+                {
+                    setParameter(processor, "Peak Gain", (i & 1) ? 3.f : -3.f);
+
+                    const auto start = Clock::now();
+                    processor.processBlock(empty, midi);
+                    total += elapsedNanoseconds(start);
+                }
+
+                return total / numCalls;
+            }));
+
+            processor.releaseResources();
+        }
+    }
+
+    /*
+     updateFilters on its own, with the same two cases as the empty blocks: nothing changed
+     (reading the settings and comparing them) and the peak gain moving before every call
+     (a redesign, the new coefficients applied and published, and a new auto gain).
+     */
+    void benchmarkUpdateFilters(Report& report, const juce::Array<double>& sampleRates, int numCalls, int numRuns)
+    {
+        JhanEQAudioProcessor processor;
+        setParameter(processor, "HighPass Slope", 3.f);
+        setParameter(processor, "LowPass Slope", 3.f);
+
+        for( auto sampleRate : sampleRates )
+        {
+            processor.setRateAndBufferSizeDetails(sampleRate, 512);
+            processor.prepareToPlay(sampleRate, 512);
+
+            juce::NamedValueSet fields;
+            fields.set("sampleRate", sampleRate);
+
+            report.add("updateFilters/unchanged", fields, "Call", bestOf(numRuns, [&]
+            {
+                const auto start = Clock::now();
+
+                for( int i = 0; i < numCalls; ++i )
+                    processor.updateFiltersForBenchmark();
+
+                return elapsedNanoseconds(start) / numCalls;
+            }));
+
+            report.add("updateFilters/changed", fields, "Call", bestOf(numRuns, [&]
+            {
+                double total = 0.0;
+
+                for( int i = 0; i < numCalls; ++i )
+                {
+                    setParameter(processor, "Peak Gain", (i & 1) ? 3.f : -3.f);
+
+                    const auto start = Clock::now();
+                    processor.updateFiltersForBenchmark();
+                    total += elapsedNanoseconds(start);
+                }
+
+                return total / numCalls;
+            }));
+
+            processor.releaseResources();
+        }
+    }
+
+    /*
+     each design on its own, with the steepest slopes.
+     */
+    void benchmarkDesigns(Report& report, const juce::Array<double>& sampleRates, int numCalls, int numRuns)
+    {
+        ChainSettings chainSettings;
+        chainSettings.peakFreq = 1000.f;
+        chainSettings.peakGainDecibels = 6.f;
+        chainSettings.peakQuality = 1.f;
+        chainSettings.highPassFreq = 40.f;
+        chainSettings.lowPassFreq = 16000.f;
+        chainSettings.highPassSlope = Slope_48;
+        chainSettings.lowPassSlope = Slope_48;
+
+        for( auto sampleRate : sampleRates )
+        {
+            juce::NamedValueSet fields;
+            fields.set("sampleRate", sampleRate);
+
+            auto timeDesign = [&](const juce::String& name, auto&& design)
+            {
+                report.add(name, fields, "Call", bestOf(numRuns, [&]
+                {
+                    const auto start = Clock::now();
+
+                    for( int i = 0; i < numCalls; ++i )
+                    {
+                        //a slightly different frequency every call, so nothing gets hoisted out of the loop
+                        chainSettings.peakFreq = 1000.f + float(i & 7);
+                        design();
+                    }
+
+                    return elapsedNanoseconds(start) / numCalls;
+                }));
+            };
+
+            timeDesign("makePeakFilter", [&] { return makePeakFilter(chainSettings, sampleRate); });
+            timeDesign("makeHighPassFilter", [&] { return makeHighPassFilter(chainSettings, sampleRate); });
+            timeDesign("makeLowPassFilter", [&] { return makeLowPassFilter(chainSettings, sampleRate); });
+
+            volatile float sink = 0.f;
+            timeDesign("makeChainCoefficients", [&] { sink = makeChainCoefficients(chainSettings, sampleRate).peak[0]; });
+        }
+    }
+
+    /*
+     one frame of two traces (they share an FFT) at every resolution the analyzer offers.
+     */
+    void benchmarkFFT(Report& report, int numCalls, int numRuns)
+    {
+        FFTPlans plans;
+
+        SampleRing left, right;
+        left.prepare(JhanEQAudioProcessor::analyzerRingSize);
+        right.prepare(JhanEQAudioProcessor::analyzerRingSize);
+
+        juce::Random random(1);
+        std::vector<float> noise((size_t)JhanEQAudioProcessor::analyzerRingSize);
+
+        for( auto& sample : noise )
+            sample = random.nextFloat() * 2.f - 1.f;
+
+        left.push(noise.data(), (int)noise.size());
+        right.push(noise.data(), (int)noise.size());
+
+        FFTDataGenerator<FFTFrame> generator;
+        generator.prepare(plans);
+
+        FFTDataGenerator<FFTFrame>::TraceSources sources;
+        sources[0].a = &left;
+        sources[1].a = &right;
+        generator.setTraces(sources);
+
+        FFTFrame frame;
+        frame.bins.resize((size_t)FFTPlans::getMaxFFTSize() * 2, 0.f);
+
+        for( auto order : { FFTOrder::order2048, FFTOrder::order4096, FFTOrder::order8192 } )
+        {
+            for( auto zeroPadFactor : { 1, 4 } )
+            {
+                generator.setResolution(order, zeroPadFactor);
+
+                juce::NamedValueSet fields;
+                fields.set("windowSize", generator.getWindowSize());
+                fields.set("fftSize", generator.getFFTSize());
+                fields.set("traces", 2);
+
+                report.add("produceFFTDataForRendering", fields, "Call", bestOf(numRuns, [&]
+                {
+                    const auto windowStart = left.getWritePosition() - generator.getWindowSize();
+                    double total = 0.0;
+
+                    for( int i = 0; i < numCalls; ++i )
+                    {
+                        const auto start = Clock::now();
+                        generator.produceFFTDataForRendering(windowStart, 48000.0, -48.f);
+                        total += elapsedNanoseconds(start);
+
+                        //the display would pull it, so the fifo never fills up
+                        generator.getFFTData(frame);
+                    }
+
+                    return total / numCalls;
+                }));
+            }
+        }
+    }
+
+    /*
+     magnitudes to decibels for 8192 bins, the most the analyzer ever shows, in every mode.
+     the magnitudes cover the whole range the kernel sees, including bins below the floor.
+     */
+    void benchmarkSpectrumKernel(Report& report, int numCalls, int numRuns)
+    {
+        constexpr int numBins = 8192;
+
+        juce::Random random(1);
+        std::vector<float> magnitudes((size_t)numBins), decibels((size_t)numBins);
+
+        for( auto& magnitude : magnitudes )
+            magnitude = std::pow(10.f, random.nextFloat() * 8.f - 7.f);
+
+        SpectrumKernel kernel;
+        kernel.prepare(numBins);
+
+        const std::pair<SpectrumKernel::Mode, const char*> modes[]
+        {
+            { SpectrumKernel::Mode::Instant, "Instant" },
+            { SpectrumKernel::Mode::Average, "Average" },
+            { SpectrumKernel::Mode::PeakHold, "PeakHold" }
+        };
+
+        for( auto& mode : modes )
+        {
+            juce::NamedValueSet fields;
+            fields.set("numBins", numBins);
+            fields.set("mode", mode.second);
+
+            kernel.reset();
+
+            report.add("SpectrumKernel::process", fields, "Call", bestOf(numRuns, [&]
+            {
+                const auto start = Clock::now();
+
+                for( int i = 0; i < numCalls; ++i )
+                    kernel.process(magnitudes.data(), decibels.data(), numBins, 1.f, -120.f, mode.first, 0.2f, 0.5f);
+
+                return elapsedNanoseconds(start) / numCalls;
+            }));
+        }
+    }
+
+    /*
+     the tap the ring replaced: every sample copied into a block buffer one at a time, and a
+     full buffer pushed by value into a 30 slot fifo. kept here only to compare against.
+     */
+    struct OldTap
+    {
+        void prepare(int blockSize)
+        {
+            bufferToFill.setSize(1, blockSize);
+            pulled.setSize(1, blockSize);
+
+            for( auto& slot : slots )
+                slot.setSize(1, blockSize);
+
+            fifoIndex = 0;
+        }
+
+        void push(const float* samples, int numSamples)
+        {
+            for( int i = 0; i < numSamples; ++i )
+            {
+                if( fifoIndex == bufferToFill.getNumSamples() )
+                {
+                    auto write = fifo.write(1);
+                    if( write.blockSize1 > 0 )
+                        slots[(size_t)write.startIndex1] = bufferToFill;
+
+                    fifoIndex = 0;
+                }
+
+                bufferToFill.setSample(0, fifoIndex++, samples[i]);
+            }
+        }
+
+        //what the editor did with every buffer
+        void drain()
+        {
+            while( fifo.getNumReady() > 0 )
+            {
+                auto read = fifo.read(1);
+                pulled = slots[(size_t)read.startIndex1];
+            }
+        }
+
+        juce::AudioBuffer<float> bufferToFill, pulled;
+        std::array<juce::AudioBuffer<float>, 30> slots;
+        juce::AbstractFifo fifo { 30 };
+        int fifoIndex = 0;
+    };
+
+    /*
+     the tap side of the analyzer per host block, the ring against the tap it replaced.
+     the old tap's reader has to keep draining or its fifo fills up, the ring's doesn't.
+     */
+    void benchmarkSampleRing(Report& report, int numCalls, int numRuns)
+    {
+        juce::Random random(1);
+        std::vector<float> noise(2048);
+
+        for( auto& sample : noise )
+            sample = random.nextFloat() * 2.f - 1.f;
+
+        SampleRing ring;
+        ring.prepare(JhanEQAudioProcessor::analyzerRingSize);
+
+        for( auto blockSize : { 32, 2048 } )
+        {
+            juce::NamedValueSet fields;
+            fields.set("blockSize", blockSize);
+
+            report.add("SampleRing::push", fields, "Call", bestOf(numRuns, [&]
+            {
+                const auto start = Clock::now();
+
+                for( int i = 0; i < numCalls; ++i )
+                    ring.push(noise.data(), blockSize);
+
+                return elapsedNanoseconds(start) / numCalls;
+            }));
+
+            OldTap oldTap;
+            oldTap.prepare(blockSize);
+
+            report.add("oldTap::push", fields, "Call", bestOf(numRuns, [&]
+            {
+                const auto start = Clock::now();
+
+                for( int i = 0; i < numCalls; ++i )
+                {
+                    oldTap.push(noise.data(), blockSize);
+                    oldTap.drain();
+                }
+
+                return elapsedNanoseconds(start) / numCalls;
+            }));
+        }
+    }
+
+    /*
+     opening the editor on a prepared processor: the constructor on its own, and up to the
+     end of the first paint, rendered into an image since there's no window to put it in.
+     */
+    void benchmarkEditorOpen(Report& report, int numRuns)
+    {
+        JhanEQAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails(48000.0, 512);
+        processor.prepareToPlay(48000.0, 512);
+
+        auto construction = std::numeric_limits<double>::max(), open = construction;
+
+        for( int run = 0; run < numRuns; ++run )
+        {
+            std::unique_ptr<juce::AudioProcessorEditor> editor(processor.createEditor());
+
+            juce::Image image(juce::Image::ARGB, editor->getWidth(), editor->getHeight(), true);
+            juce::Graphics g(image);
+            editor->paintEntireComponent(g, false);
+
+            if( auto* jhanEditor = dynamic_cast<JhanEQAudioProcessorEditor*>(editor.get()) )
+            {
+                construction = juce::jmin(construction, jhanEditor->getConstructionDurationMs() * 1.0e6);
+                open = juce::jmin(open, jhanEditor->getOpenDurationMs() * 1.0e6);
+            }
+        }
+
+        processor.releaseResources();
+
+        report.add("editor/construct", {}, "Call", construction);
+        report.add("editor/open", {}, "Call", open);
+    }
+
+    //==============================================================================
+    /*
+     prints the ratio of every result to the matching one in the baseline and returns
+     false if any of them got slower than 'threshold' times the baseline.
+     */
+    bool compare(const juce::Array<juce::var>& results, const juce::File& baselineFile, double threshold)
+    {
+        std::map<juce::String, double> baseline;
+
+        for( auto& line : juce::StringArray::fromLines(baselineFile.loadFileAsString()) )
+        {
+            auto result = juce::JSON::parse(line);
+
+            if( result.hasProperty("name") )
+                baseline[getKey(result)] = getNanoseconds(result);
+        }
+
+        bool passed = true;
+
+        for( auto& result : results )
+        {
+            auto match = baseline.find(getKey(result));
+
+            if( match == baseline.end() || match->second <= 0.0 )
+                continue;
+
+            const auto ratio = getNanoseconds(result) / match->second;
+
+            if( ratio > threshold )
+            {
+                std::cerr << "slower: " << getKey(result) << " " << ratio << "x" << std::endl;
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    /*
+     --quick              48 kHz and a few block sizes only, for a fast check
+     --label=<text>       stored with the results, e.g. the commit
+     --output=<file>      the results, one JSON object per line (default: stdout)
+     --compare=<file>     an earlier --output. exits with 1 if anything got slower than
+     --threshold=<ratio>  this many times its time there (default 1.1)
+     */
+    juce::ArgumentList arguments(argc, argv);
+
+    //the parameters' listeners and the state's timer want a message manager
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const auto quick = arguments.containsOption("--quick");
+
+    juce::Array<double> sampleRates { 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+    juce::Array<int> blockSizes;
+
+    if( quick )
+    {
+        sampleRates = { 48000.0 };
+        blockSizes = { 1, 64, 512, 8192 };
+    }
+    else
+    {
+        for( int blockSize = 1; blockSize <= 8192; blockSize *= 2 )
+            blockSizes.add(blockSize);
+    }
+
+    const auto numRuns = quick ? 3 : 5;
+
+    Report report;
+    report.cyclesPerNanosecond = measureCyclesPerNanosecond();
+
+    benchmarkProcessBlock(report, sampleRates, blockSizes, 1 << 16, numRuns);
+    benchmarkEmptyBlocks(report, sampleRates, 1000, numRuns);
+    benchmarkUpdateFilters(report, sampleRates, 1000, numRuns);
+    benchmarkDesigns(report, sampleRates, 1000, numRuns);
+    benchmarkFFT(report, 50, numRuns);
+    benchmarkSpectrumKernel(report, 1000, numRuns);
+    benchmarkSampleRing(report, 10000, numRuns);
+    benchmarkEditorOpen(report, numRuns);
+
+    //the first line says what produced the rest
+    auto* info = new juce::DynamicObject();
+    info->setProperty("label", arguments.getValueForOption("--label"));
+    info->setProperty("juceVersion", juce::SystemStats::getJUCEVersion());
+    info->setProperty("cpu", juce::SystemStats::getCpuModel());
+    info->setProperty("cyclesPerNs", report.cyclesPerNanosecond);
+
+    juce::String output = juce::JSON::toString(juce::var(info), true) + "\n";
+
+    for( auto& result : report.results )
+        output << juce::JSON::toString(result, true) << "\n";
+
+    const auto workingDirectory = juce::File::getCurrentWorkingDirectory();
+
+    if( arguments.containsOption("--output") )
+        workingDirectory.getChildFile(arguments.getValueForOption("--output")).replaceWithText(output);
+    else
+        std::cout << output;
+
+    if( arguments.containsOption("--compare") )
+    {
+        const auto baselineFile = workingDirectory.getChildFile(arguments.getValueForOption("--compare"));
+        const auto threshold = arguments.containsOption("--threshold") ? arguments.getValueForOption("--threshold").getDoubleValue() : 1.1;
+
+        if( ! baselineFile.existsAsFile() )
+        {
+            std::cerr << "no baseline at " << baselineFile.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        if( ! compare(report.results, baselineFile, threshold) )
+            return 1;
+    }
+
+    return 0;
+}
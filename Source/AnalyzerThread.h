@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    AnalyzerThread.h
+    One background thread, shared by every open editor, that does the
+    analyzer's FFT and path work away from the message thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/*
+ hold it through a juce::SharedResourcePointer<AnalyzerThread>: the first editor
+ starts the thread, the last one to close stops it.
+
+ the audio thread never signals the thread (that would mean taking a lock in the
+ callback), so instead each client says how long until it expects its next frame
+ and the thread sleeps exactly that long. adding a client or calling wake() cuts
+ the sleep short.
+ */
+struct AnalyzerThread : private juce::Thread
+{
+    struct Client
+    {
+        virtual ~Client() = default;
+
+        /*
+         runs on the analyzer thread. does whatever work is ready and returns the
+         number of milliseconds until it expects to have more.
+         */
+        virtual double analyze() = 0;
+    };
+
+    AnalyzerThread() : juce::Thread("JhanEQ Analyzer")
+    {
+        startThread(3);
+    }
+
+    ~AnalyzerThread() override
+    {
+        signalThreadShouldExit();
+        wakeUp.signal();
+        stopThread(2000);
+    }
+
+    void addClient(Client* client)
+    {
+        {
+            const juce::ScopedLock sl(clientLock);
+            clients.addIfNotAlreadyThere(client);
+        }
+
+        wake();
+    }
+
+    /*
+     once this returns the client isn't running and won't be called again.
+     */
+    void removeClient(Client* client)
+    {
+        const juce::ScopedLock sl(clientLock);
+        clients.removeFirstMatchingValue(client);
+    }
+
+    void wake() { wakeUp.signal(); }
+private:
+    static constexpr double maxSleepMs = 100.0;
+
+    juce::CriticalSection clientLock;
+    juce::Array<Client*> clients;
+    juce::WaitableEvent wakeUp;
+
+    void run() override
+    {
+        while( ! threadShouldExit() )
+        {
+            auto sleepMs = maxSleepMs;
+            bool anyClients = false;
+
+            {
+                const juce::ScopedLock sl(clientLock);
+                anyClients = ! clients.isEmpty();
+
+                for( auto* client : clients )
+                    sleepMs = juce::jmin(sleepMs, client->analyze());
+            }
+
+            //nothing to do until an editor opens
+            if( ! anyClients )
+                wakeUp.wait(-1);
+            else
+                wakeUp.wait(juce::jlimit(1, (int)maxSleepMs, (int)std::ceil(sleepMs)));
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE(AnalyzerThread)
+};
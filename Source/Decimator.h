@@ -0,0 +1,146 @@
+/*
+  ==============================================================================
+
+    Decimator.h
+    Cascade of half-band filters that brings the analyzer's low band down to
+    a rate where a small FFT has fine bins.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ every stage halves the rate. a half-band FIR has every other tap at zero, so
+ each output of the 23 tap filter costs 7 multiplies.
+
+ the passband is flat to within 0.003 dB and anything that would alias into the
+ lowest 1/12 of the output band is down by more than 75 dB, which is all the
+ analyzer uses the low band for.
+ */
+struct HalfBandDecimator
+{
+    static constexpr int numTaps = 23;
+    static constexpr int maxNumStages = 5;
+
+    /*
+     allocates for blocks of up to maxBlockSize input samples. not thread safe.
+     */
+    void prepare(int maxBlockSize)
+    {
+        makeCoefficients();
+
+        for( auto& stage : stages )
+            stage.assign((size_t)(numTaps - 1 + maxBlockSize), 0.f);
+
+        blockSize = maxBlockSize;
+        reset();
+    }
+
+    /*
+     the rate goes down by 2^numStages. clears the filter state.
+     */
+    void setNumStages(int newNumStages)
+    {
+        numStages = std::max(0, std::min(maxNumStages, newNumStages));
+        reset();
+    }
+
+    int getNumStages() const { return numStages; }
+    int getFactor() const { return 1 << numStages; }
+    int getMaxBlockSize() const { return blockSize; }
+
+    void reset()
+    {
+        for( auto& stage : stages )
+            std::fill(stage.begin(), stage.end(), 0.f);
+    }
+
+    /*
+     numInput has to be a multiple of getFactor() and no more than the prepared block size.
+     writes numInput / getFactor() samples to output and returns that count.
+     output may be the same as input.
+     */
+    int process(const float* input, int numInput, float* output)
+    {
+        numInput = std::min(numInput, blockSize);
+
+        if( numStages == 0 )
+        {
+            std::copy(input, input + numInput, output);
+            return numInput;
+        }
+
+        const float* source = input;
+        int numSamples = numInput;
+
+        for( int s = 0; s < numStages; ++s )
+        {
+            auto& history = stages[(size_t)s];
+            auto* buffer = history.data();
+
+            //the last numTaps - 1 inputs are already at the front from the previous block
+            std::copy(source, source + numSamples, buffer + numTaps - 1);
+
+            const int numOut = numSamples / 2;
+
+            for( int j = 0; j < numOut; ++j )
+            {
+                const auto* x = buffer + 2 * j;
+                auto sum = centreTap * x[centre];
+
+                for( int i = 0; i < centre; i += 2 )
+                    sum += coefficients[(size_t)(i / 2)] * (x[i] + x[numTaps - 1 - i]);
+
+                output[j] = sum;
+            }
+
+            std::copy(buffer + numSamples, buffer + numSamples + numTaps - 1, buffer);
+
+            source = output;
+            numSamples = numOut;
+        }
+
+        return numSamples;
+    }
+private:
+    static constexpr int centre = (numTaps - 1) / 2;
+
+    //the non zero taps left of the centre, the filter is symmetric
+    std::vector<float> coefficients;
+    float centreTap = 0.5f;
+
+    std::vector<float> stages[maxNumStages];
+    int numStages = 0;
+    int blockSize = 0;
+
+    void makeCoefficients()
+    {
+        //blackman windowed sinc with its cutoff at a quarter of the input rate
+        std::vector<double> h((size_t)numTaps);
+        double sum = 0.0;
+
+        for( int i = 0; i < numTaps; ++i )
+        {
+            const auto n = i - centre;
+            const auto phase = 2.0 * 3.14159265358979323846 * (i + 1) / (numTaps + 1);
+            const auto window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+            const auto sinc = n == 0 ? 0.5 : std::sin(3.14159265358979323846 * n / 2.0) / (3.14159265358979323846 * n);
+
+            h[(size_t)i] = sinc * window;
+            sum += h[(size_t)i];
+        }
+
+        //unity gain at DC, so the low band reads the same level as the full rate one
+        coefficients.clear();
+
+        for( int i = 0; i < centre; i += 2 )
+            coefficients.push_back(float(h[(size_t)i] / sum));
+
+        centreTap = float(h[(size_t)centre] / sum);
+    }
+};
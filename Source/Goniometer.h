@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    Goniometer.h
+    Bounded rate stream of stereo points from processBlock to the goniometer.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "SampleRing.h"
+
+/*
+ every step'th stereo sample becomes a point, with the step carried over from block
+ to block. the points per second only depend on the sample rate, and they are
+ collected into chunks of 64 before they go into the ring, so the number of pushes
+ (and their atomics) doesn't depend on the block size either. a host running 16
+ sample blocks pays for about the same as one running 2048 sample blocks.
+
+ points are plain samples, not filtered ones: a goniometer shows where L and R are
+ relative to each other, and a pair taken at the same instant keeps that exactly.
+
+ the points go through a SampleRing as interleaved L, R pairs. one producer (the
+ audio thread) and one reader.
+ */
+struct GoniometerFeed
+{
+    static constexpr double maxPointsPerSecond = 12000.0;
+    static constexpr int ringSize = 1 << 14; //floats, so 8192 points
+
+    /*
+     call from prepareToPlay. doesn't touch the ring.
+     */
+    void prepare(double sampleRate)
+    {
+        step = std::max(1, (int)std::ceil(sampleRate / maxPointsPerSecond));
+        offset = 0;
+        numPending = 0;
+    }
+
+    /*
+     the ring is only allocated while somebody is looking at it.
+     not thread safe, call while the audio thread isn't pushing.
+     */
+    void allocate() { ring.prepare(ringSize); offset = 0; numPending = 0; }
+    void release() { ring.release(); }
+
+    //==============================================================================
+    // audio thread
+
+    void process(const float* left, const float* right, int numSamples)
+    {
+        int i = offset;
+
+        for( ; i < numSamples; i += step )
+        {
+            pending[2 * numPending] = left[i];
+            pending[2 * numPending + 1] = right[i];
+
+            if( ++numPending == chunkSize )
+            {
+                ring.push(pending, 2 * chunkSize);
+                numPending = 0;
+            }
+        }
+
+        offset = i - numSamples;
+    }
+
+    //==============================================================================
+    // reader
+
+    /*
+     copies the newest maxPoints (at most) of the points pushed since the last call
+     into dest as L, R pairs and returns how many it copied. older unread points are
+     dropped, the display only has so many to show per frame anyway.
+     */
+    int readPoints(float* dest, int maxPoints)
+    {
+        if( ! ring.isPrepared() )
+            return 0;
+
+        const auto numUnread = ring.getNumUnread() / 2;
+        const auto numPoints = std::min(numUnread, maxPoints);
+        const auto start = ring.getReadPosition() + 2 * (numUnread - numPoints);
+
+        ring.advance(2 * numUnread);
+
+        return ring.copy(start, 2 * numPoints, dest) ? numPoints : 0;
+    }
+private:
+    //about 5 ms of points at the maximum rate
+    static constexpr int chunkSize = 64;
+
+    SampleRing ring;
+    int step = 4;
+    int offset = 0; //where the next point falls in the next block
+
+    float pending[2 * chunkSize] {};
+    int numPending = 0;
+};
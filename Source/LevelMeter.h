@@ -0,0 +1,476 @@
+/*
+  ==============================================================================
+
+    LevelMeter.h
+    Peak, RMS, true-peak and loudness metering that runs inside processBlock.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ what the editor reads. the peaks are the highest since the last read (reading
+ resets them), the rest are the latest values. all of them are linear: the
+ decibel and LUFS maths happens on the reading side, not in the callback.
+ */
+struct LevelMeterValues
+{
+    static constexpr int maxChannels = 2;
+
+    std::array<std::atomic<float>, maxChannels> peak {}, truePeak {};
+    std::array<std::atomic<float>, maxChannels> meanSquare {}; //over the momentary window
+    std::atomic<float> momentaryPower { 0.f }, shortTermPower { 0.f }; //K-weighted, summed over channels
+    std::atomic<float> correlation { 0.f }; //L/R, -1 to +1 over the momentary window
+
+    //-0.691 + 10 log10(power), BS.1770
+    static float toLUFS(float power) { return power > 0.f ? -0.691f + 10.f * std::log10(power) : -100.f; }
+
+    float takePeak(int channel) { return peak[(size_t)channel].exchange(0.f, std::memory_order_relaxed); }
+    float takeTruePeak(int channel) { return truePeak[(size_t)channel].exchange(0.f, std::memory_order_relaxed); }
+};
+
+/*
+ the per sample work is one pass of two K-weighting biquads plus a 4x polyphase
+ interpolator for the true peak. everything else is loops the compiler vectorizes:
+ peaks are found as integer maxima of the sign-less float bits, squares are summed
+ in 8 independent lanes, and the interpolator runs one multiply-add pass per tap.
+
+ loudness is kept as 100 ms sub-block sums, momentary is the last 4 of them and
+ short-term the last 30, as in BS.1770 / EBU R128. the correlation comes from the
+ same sub-blocks: the sum of L * R over the momentary window against the square
+ root of the product of the two sums of squares.
+ */
+struct LevelMeter
+{
+    /*
+     not real time safe, call from prepareToPlay.
+     */
+    void prepare(double sampleRate, int maximumBlockSize)
+    {
+        makeInterpolator();
+        makeKWeighting(sampleRate);
+
+        subBlockLength = std::max(1, (int)std::lround(sampleRate * 0.1));
+
+        for( auto& channel : channels )
+        {
+            channel.history.assign((size_t)(tapsPerPhase - 1 + maximumBlockSize), 0.f);
+            channel.weighted.assign((size_t)maximumBlockSize, 0.f);
+        }
+
+        interpolated.assign((size_t)maximumBlockSize, 0.f);
+        blockSize = maximumBlockSize;
+
+        reset();
+    }
+
+    /*
+     forgets all history. the audio thread has to be stopped, or this has to run on it.
+     */
+    void reset()
+    {
+        for( auto& channel : channels )
+        {
+            std::fill(channel.history.begin(), channel.history.end(), 0.f);
+            channel.kState = {};
+            channel.subBlocks.fill({});
+            channel.current = {};
+        }
+
+        crossProducts.fill(0.0);
+        currentCrossProduct = 0.0;
+        crossProductIndex = 0;
+        numSubBlockSamples = 0;
+        subBlockIndex = 0;
+    }
+
+    /*
+     meters one block. channel c of 'channelData' is meter channel c, extra channels are ignored.
+     */
+    void process(const float* const* channelData, int numChannels, int numSamples, LevelMeterValues& values)
+    {
+        if( blockSize <= 0 )
+            return;
+
+        numChannels = std::min(numChannels, (int)channels.size());
+
+        //blocks larger than prepared for are metered in pieces
+        for( int start = 0; start < numSamples; )
+        {
+            auto n = std::min(numSamples - start, std::min(blockSize, subBlockLength - numSubBlockSamples));
+
+            for( int c = 0; c < numChannels; ++c )
+                processChannel(channels[(size_t)c], channelData[c] + start, n, c, values);
+
+            applyKWeighting(numChannels, n);
+            
+            if( numChannels == 2 )
+                currentCrossProduct += sumOfProducts(channels[0].history.data() + tapsPerPhase - 1,
+                                                     channels[1].history.data() + tapsPerPhase - 1, n);
+
+            for( int c = 0; c < numChannels; ++c )
+            {
+                auto& channel = channels[(size_t)c];
+                channel.current.weightedSquares += sumOfSquares(channel.weighted.data(), n);
+
+                //keep the last tapsPerPhase - 1 inputs in front for the next block
+                auto* x = channel.history.data() + tapsPerPhase - 1;
+                std::copy(x + n - (tapsPerPhase - 1), x + n, channel.history.data());
+            }
+
+            start += n;
+            numSubBlockSamples += n;
+
+            if( numSubBlockSamples == subBlockLength )
+                finishSubBlock(numChannels, values);
+        }
+    }
+
+    //==============================================================================
+    //the kernels, exposed for the benchmark
+
+    static inline std::uint32_t absBits(float x)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return bits & 0x7fffffffu;
+    }
+
+    static inline float fromBits(std::uint32_t bits)
+    {
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        return x;
+    }
+
+    /*
+     largest |x|. sign-less floats order the same as their bits, and an integer max
+     vectorizes where a float compare (which could trap) doesn't.
+     */
+    static float findAbsMax(const float* x, int n)
+    {
+        std::uint32_t maxBits = 0;
+
+        for( int i = 0; i < n; ++i )
+            maxBits = std::max(maxBits, absBits(x[i]));
+
+        return fromBits(maxBits);
+    }
+
+    /*
+     sum of x^2 in 8 independent lanes, so the adds don't have to be reordered to vectorize.
+     */
+    static double sumOfSquares(const float* x, int n)
+    {
+        float lanes[8] = {};
+        int i = 0;
+
+        for( ; i + 8 <= n; i += 8 )
+            for( int j = 0; j < 8; ++j )
+                lanes[j] += x[i + j] * x[i + j];
+
+        double sum = 0.0;
+
+        for( int j = 0; j < 8; ++j )
+            sum += lanes[j];
+
+        for( ; i < n; ++i )
+            sum += double(x[i]) * x[i];
+
+        return sum;
+    }
+
+    /*
+     sum of x * y, in lanes like sumOfSquares.
+     */
+    static double sumOfProducts(const float* x, const float* y, int n)
+    {
+        float lanes[8] = {};
+        int i = 0;
+
+        for( ; i + 8 <= n; i += 8 )
+            for( int j = 0; j < 8; ++j )
+                lanes[j] += x[i + j] * y[i + j];
+
+        double sum = 0.0;
+
+        for( int j = 0; j < 8; ++j )
+            sum += lanes[j];
+
+        for( ; i < n; ++i )
+            sum += double(x[i]) * y[i];
+
+        return sum;
+    }
+private:
+    static constexpr int oversampling = 4;
+    static constexpr int tapsPerPhase = 12;
+
+    struct Biquad
+    {
+        float b0 = 1.f, b1 = 0.f, b2 = 0.f, a1 = 0.f, a2 = 0.f;
+    };
+
+    struct SubBlock
+    {
+        double squares = 0.0, weightedSquares = 0.0;
+    };
+
+    struct Channel
+    {
+        std::vector<float> history; //tapsPerPhase - 1 samples of the last block, then this block
+        std::vector<float> weighted;
+        std::array<float, 4> kState {};
+        std::array<SubBlock, 30> subBlocks {};
+        SubBlock current;
+    };
+
+    std::array<Channel, LevelMeterValues::maxChannels> channels;
+    std::array<double, 4> crossProducts {}; //L * R of the sub-blocks in the momentary window
+    double currentCrossProduct = 0.0;
+    int crossProductIndex = 0;
+    std::vector<float> interpolated;
+    int blockSize = 0;
+
+    //phase p, tap t at [p * tapsPerPhase + t]
+    std::array<float, oversampling * tapsPerPhase> interpolator {};
+    std::array<Biquad, 2> kWeighting;
+
+    int subBlockLength = 4800, numSubBlockSamples = 0;
+    int subBlockIndex = 0;
+
+    void processChannel(Channel& channel, const float* input, int n, int channelIndex, LevelMeterValues& values)
+    {
+        auto* x = channel.history.data() + tapsPerPhase - 1;
+        std::copy(input, input + n, x);
+
+        //sample peak
+        publishMax(values.peak[(size_t)channelIndex], findAbsMax(x, n));
+
+        //true peak: every phase of the 4x interpolation, one vectorized multiply-add per tap
+        auto truePeak = 0.f;
+        auto* y = interpolated.data();
+
+        for( int p = 0; p < oversampling; ++p )
+        {
+            const auto* h = interpolator.data() + p * tapsPerPhase;
+            std::fill(y, y + n, 0.f);
+
+            for( int t = 0; t < tapsPerPhase; ++t )
+            {
+                const auto coefficient = h[t];
+                const auto* source = x - t;
+
+                for( int i = 0; i < n; ++i )
+                    y[i] += coefficient * source[i];
+            }
+
+            truePeak = std::max(truePeak, findAbsMax(y, n));
+        }
+
+        publishMax(values.truePeak[(size_t)channelIndex], truePeak);
+
+        channel.current.squares += sumOfSquares(x, n);
+    }
+
+    /*
+     the only part that has to go sample by sample. a biquad is bound by the latency of
+     its own feedback, so the channels run side by side in one loop to overlap theirs.
+     always both channels, which keeps the inner loop a fixed size: a missing channel
+     just filters whatever its buffer held.
+     */
+    void applyKWeighting(int numChannels, int n)
+    {
+        constexpr int maxChannels = LevelMeterValues::maxChannels;
+        const auto& f0 = kWeighting[0];
+        const auto& f1 = kWeighting[1];
+
+        float s[4][maxChannels];
+        const float* x[maxChannels];
+        float* w[maxChannels];
+
+        for( int c = 0; c < maxChannels; ++c )
+        {
+            auto& channel = channels[(size_t)c];
+
+            for( int k = 0; k < 4; ++k )
+                s[k][c] = channel.kState[(size_t)k];
+
+            x[c] = channel.history.data() + tapsPerPhase - 1;
+            w[c] = channel.weighted.data();
+        }
+
+        for( int i = 0; i < n; ++i )
+        {
+            for( int c = 0; c < maxChannels; ++c )
+            {
+                const auto in0 = x[c][i];
+                const auto out0 = f0.b0 * in0 + s[0][c];
+                s[0][c] = f0.b1 * in0 - f0.a1 * out0 + s[1][c];
+                s[1][c] = f0.b2 * in0 - f0.a2 * out0;
+
+                const auto out1 = f1.b0 * out0 + s[2][c];
+                s[2][c] = f1.b1 * out0 - f1.a1 * out1 + s[3][c];
+                s[3][c] = f1.b2 * out0 - f1.a2 * out1;
+
+                w[c][i] = out1;
+            }
+        }
+
+        for( int c = 0; c < numChannels; ++c )
+        {
+            auto& state = channels[(size_t)c].kState;
+
+            for( int k = 0; k < 4; ++k )
+            {
+                //denormals would otherwise linger in the state after the input goes silent
+                state[(size_t)k] = std::abs(s[k][c]) < 1.0e-15f ? 0.f : s[k][c];
+            }
+        }
+    }
+
+    void finishSubBlock(int numChannels, LevelMeterValues& values)
+    {
+        double momentary = 0.0, shortTerm = 0.0;
+        double energy[LevelMeterValues::maxChannels] = {};
+        const auto numBlocks = (int)channels[0].subBlocks.size();
+
+        for( int c = 0; c < numChannels; ++c )
+        {
+            auto& channel = channels[(size_t)c];
+            channel.subBlocks[(size_t)subBlockIndex] = channel.current;
+            channel.current = {};
+
+            double squares = 0.0, weightedMomentary = 0.0, weightedShortTerm = 0.0;
+
+            for( int b = 0; b < numBlocks; ++b )
+            {
+                const auto& block = channel.subBlocks[(size_t)((subBlockIndex - b + numBlocks) % numBlocks)];
+
+                if( b < 4 )
+                {
+                    squares += block.squares;
+                    weightedMomentary += block.weightedSquares;
+                }
+
+                weightedShortTerm += block.weightedSquares;
+            }
+
+            const auto momentaryLength = double(subBlockLength) * 4.0;
+            values.meanSquare[(size_t)c].store(float(squares / momentaryLength), std::memory_order_relaxed);
+            energy[c] = squares;
+
+            //both channels weigh 1.0 in BS.1770
+            momentary += weightedMomentary / momentaryLength;
+            shortTerm += weightedShortTerm / (double(subBlockLength) * numBlocks);
+        }
+
+        values.momentaryPower.store((float)momentary, std::memory_order_relaxed);
+        values.shortTermPower.store((float)shortTerm, std::memory_order_relaxed);
+
+        crossProducts[(size_t)crossProductIndex] = currentCrossProduct;
+        crossProductIndex = (crossProductIndex + 1) % (int)crossProducts.size();
+        currentCrossProduct = 0.0;
+
+        //mono is fully correlated, silence (below about -100 dBFS) reads as 0
+        auto correlation = 1.0;
+
+        if( numChannels == 2 )
+        {
+            const auto crossProduct = crossProducts[0] + crossProducts[1] + crossProducts[2] + crossProducts[3];
+            const auto silence = 1.0e-10 * double(subBlockLength) * 4.0;
+
+            correlation = energy[0] > silence && energy[1] > silence
+                            ? std::max(-1.0, std::min(1.0, crossProduct / std::sqrt(energy[0] * energy[1])))
+                            : 0.0;
+        }
+
+        values.correlation.store((float)correlation, std::memory_order_relaxed);
+
+        subBlockIndex = (subBlockIndex + 1) % numBlocks;
+        numSubBlockSamples = 0;
+    }
+
+    static void publishMax(std::atomic<float>& target, float value)
+    {
+        auto current = target.load(std::memory_order_relaxed);
+
+        while( value > current && ! target.compare_exchange_weak(current, value, std::memory_order_relaxed) )
+        { }
+    }
+
+    /*
+     windowed sinc at the original Nyquist, split into 4 phases of 12 taps with unity DC gain each.
+     */
+    void makeInterpolator()
+    {
+        constexpr auto pi = 3.14159265358979323846;
+        constexpr int numTaps = oversampling * tapsPerPhase;
+        const auto centre = (numTaps - 1) / 2.0;
+
+        std::array<double, numTaps> h {};
+
+        for( int i = 0; i < numTaps; ++i )
+        {
+            const auto t = (i - centre) / oversampling;
+            const auto sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+            const auto phase = 2.0 * pi * (i + 0.5) / numTaps;
+            const auto window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+
+            h[(size_t)i] = sinc * window;
+        }
+
+        for( int p = 0; p < oversampling; ++p )
+        {
+            double sum = 0.0;
+
+            for( int t = 0; t < tapsPerPhase; ++t )
+                sum += h[(size_t)(t * oversampling + p)];
+
+            for( int t = 0; t < tapsPerPhase; ++t )
+                interpolator[(size_t)(p * tapsPerPhase + t)] = float(h[(size_t)(t * oversampling + p)] / sum);
+        }
+    }
+
+    /*
+     the BS.1770 pre-filter (high shelf) and RLB high pass, designed for any sample rate
+     the same way libebur128 does it.
+     */
+    void makeKWeighting(double sampleRate)
+    {
+        constexpr auto pi = 3.14159265358979323846;
+
+        {
+            const auto f0 = 1681.974450955533, G = 3.999843853973347, Q = 0.7071752369554196;
+            const auto K = std::tan(pi * f0 / sampleRate);
+            const auto Vh = std::pow(10.0, G / 20.0);
+            const auto Vb = std::pow(Vh, 0.4996667741545416);
+            const auto a0 = 1.0 + K / Q + K * K;
+
+            kWeighting[0] = { float((Vh + Vb * K / Q + K * K) / a0),
+                              float(2.0 * (K * K - Vh) / a0),
+                              float((Vh - Vb * K / Q + K * K) / a0),
+                              float(2.0 * (K * K - 1.0) / a0),
+                              float((1.0 - K / Q + K * K) / a0) };
+        }
+
+        {
+            const auto f0 = 38.13547087602444, Q = 0.5003270373238773;
+            const auto K = std::tan(pi * f0 / sampleRate);
+            const auto a0 = 1.0 + K / Q + K * K;
+
+            kWeighting[1] = { 1.f, -2.f, 1.f,
+                              float(2.0 * (K * K - 1.0) / a0),
+                              float((1.0 - K / Q + K * K) / a0) };
+        }
+    }
+};
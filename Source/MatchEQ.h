@@ -0,0 +1,440 @@
+/*
+  ==============================================================================
+
+    MatchEQ.h
+    Long-term spectrum capture of a reference and the input, and a fitter that
+    moves the HighPass / Peak / LowPass parameters towards the difference.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+#include <numeric>
+
+/*
+ running mean / variance of a dB spectrum, one Welford accumulator per bin.
+ memory only depends on the number of bins, never on how long we capture.
+ */
+struct SpectrumAverage
+{
+    void prepare(int numBinsToUse)
+    {
+        numBins = numBinsToUse;
+        mean.assign(numBins, 0.0);
+        m2.assign(numBins, 0.0);
+        count = 0;
+    }
+
+    void addFrame(const float* frame)
+    {
+        ++count;
+        const auto n = double(count);
+
+        for( int i = 0; i < numBins; ++i )
+        {
+            auto x = double(frame[i]);
+            auto delta = x - mean[i];
+            mean[i] += delta / n;
+            m2[i] += delta * (x - mean[i]);
+        }
+    }
+    //==============================================================================
+    double getMean(int bin) const { return mean[bin]; }
+    double getVariance(int bin) const { return count > 1 ? m2[bin] / double(count - 1) : 0.0; }
+    juce::int64 getNumFrames() const { return count; }
+    int getNumBins() const { return numBins; }
+private:
+    std::vector<double> mean, m2;
+    int numBins = 0;
+    juce::int64 count = 0;
+};
+
+//==============================================================================
+struct MatchEQ : private juce::Thread,
+                 private juce::AsyncUpdater
+{
+    enum class Capture
+    {
+        None,
+        Reference,
+        Input
+    };
+
+    MatchEQ() : juce::Thread("Match EQ Fitter") { }
+
+    ~MatchEQ() override
+    {
+        stopThread(2000);
+        cancelPendingUpdate();
+    }
+
+    //==============================================================================
+    void setCapture(Capture newCapture)
+    {
+        const juce::ScopedLock sl(lock);
+        capture = newCapture;
+    }
+
+    Capture getCapture() const
+    {
+        const juce::ScopedLock sl(lock);
+        return capture;
+    }
+
+    /*
+     feeds one dB frame (as produced by FFTDataGenerator) into whichever spectrum is being captured.
+     */
+    void addFrame(const std::vector<float>& fftData, int fftSize, double sampleRate)
+    {
+        const juce::ScopedLock sl(lock);
+
+        if( capture == Capture::None )
+            return;
+
+        const auto numBins = fftSize / 2;
+        const auto binWidth = sampleRate / double(fftSize);
+
+        //spectra captured at a different resolution can't be compared, start over.
+        if( numBins != reference.getNumBins() || binWidth != captureBinWidth )
+        {
+            reference.prepare(numBins);
+            input.prepare(numBins);
+            captureBinWidth = binWidth;
+        }
+
+        jassert( (int)fftData.size() >= numBins );
+        auto& average = capture == Capture::Reference ? reference : input;
+        average.addFrame(fftData.data());
+    }
+
+    void reset()
+    {
+        const juce::ScopedLock sl(lock);
+        reference.prepare(0);
+        input.prepare(0);
+    }
+
+    juce::int64 getNumReferenceFrames() const { const juce::ScopedLock sl(lock); return reference.getNumFrames(); }
+    juce::int64 getNumInputFrames() const { const juce::ScopedLock sl(lock); return input.getNumFrames(); }
+
+    bool canFit() const
+    {
+        return getNumReferenceFrames() > 0 && getNumInputFrames() > 0 && ! isThreadRunning();
+    }
+
+    //==============================================================================
+    /*
+     snapshots both spectra and the parameter ranges, then fits on the background thread.
+     onFitComplete is called on the message thread with the fitted settings.
+     */
+    void startFit(juce::AudioProcessorValueTreeState& apvts, double sampleRate)
+    {
+        if( ! canFit() )
+            return;
+
+        fitSampleRate = sampleRate;
+
+        highPassRange = apvts.getParameterRange("HighPass Freq");
+        lowPassRange = apvts.getParameterRange("LowPass Freq");
+        peakFreqRange = apvts.getParameterRange("Peak Freq");
+        peakGainRange = apvts.getParameterRange("Peak Gain");
+        peakQualityRange = apvts.getParameterRange("Peak Quality");
+
+        buildTarget();
+        startThread();
+    }
+
+    std::function<void(const ChainSettings&)> onFitComplete;
+
+    double getLastFitDurationMs() const { return lastFitDurationMs; }
+private:
+    static constexpr int NumFitPoints = 96;
+    static constexpr int NumFitParams = 5;
+    using FitParams = std::array<double, NumFitParams>;
+
+    juce::CriticalSection lock;
+    Capture capture = Capture::None;
+    SpectrumAverage reference, input;
+    double captureBinWidth = 0;
+
+    double fitSampleRate = 44100;
+    ChainSettings fittedSettings;
+    juce::NormalisableRange<float> highPassRange, lowPassRange, peakFreqRange, peakGainRange, peakQualityRange;
+
+    std::array<double, NumFitPoints> fitFreqs, target, weights;
+    double lastFitDurationMs = 0;
+
+    /*
+     samples the smoothed reference - input difference onto a log spaced grid.
+     bins that wander a lot over the capture count for less.
+     */
+    void buildTarget()
+    {
+        const juce::ScopedLock sl(lock);
+
+        const auto numBins = reference.getNumBins();
+
+        for( int k = 0; k < NumFitPoints; ++k )
+        {
+            auto freq = juce::mapToLog10(double(k) / double(NumFitPoints - 1), 20.0, 20000.0);
+            fitFreqs[k] = freq;
+
+            //1/3 octave around this point
+            auto lo = juce::jlimit(1, numBins - 1, int(freq * std::pow(2.0, -1.0 / 6.0) / captureBinWidth));
+            auto hi = juce::jlimit(lo, numBins - 1, int(freq * std::pow(2.0, 1.0 / 6.0) / captureBinWidth + 1));
+
+            double diff = 0, variance = 0;
+            for( int bin = lo; bin <= hi; ++bin )
+            {
+                diff += reference.getMean(bin) - input.getMean(bin);
+                variance += reference.getVariance(bin) + input.getVariance(bin);
+            }
+
+            const auto n = double(hi - lo + 1);
+            target[k] = diff / n;
+            weights[k] = 1.0 / (1.0 + std::sqrt(variance / n) / 6.0);
+        }
+
+        //we match the tone, not the level: remove the weighted mean of the 100Hz - 10kHz band
+        double offset = 0, weightSum = 0;
+        for( int k = 0; k < NumFitPoints; ++k )
+        {
+            if( fitFreqs[k] >= 100.0 && fitFreqs[k] <= 10000.0 )
+            {
+                offset += target[k] * weights[k];
+                weightSum += weights[k];
+            }
+        }
+
+        if( weightSum > 0 )
+            offset /= weightSum;
+
+        for( auto& t : target )
+            t = juce::jlimit(-24.0, 24.0, t - offset);
+    }
+
+    ChainSettings toChainSettings(const FitParams& p, Slope highPassSlope, Slope lowPassSlope) const
+    {
+        auto fromNormalised = [](const juce::NormalisableRange<float>& range, double v)
+        {
+            return range.snapToLegalValue(range.convertFrom0to1((float)juce::jlimit(0.0, 1.0, v)));
+        };
+
+        ChainSettings settings;
+        settings.highPassFreq = fromNormalised(highPassRange, p[0]);
+        settings.peakFreq = fromNormalised(peakFreqRange, p[1]);
+        settings.peakGainDecibels = fromNormalised(peakGainRange, p[2]);
+        settings.peakQuality = fromNormalised(peakQualityRange, p[3]);
+        settings.lowPassFreq = fromNormalised(lowPassRange, p[4]);
+        settings.highPassSlope = highPassSlope;
+        settings.lowPassSlope = lowPassSlope;
+
+        return settings;
+    }
+
+    double getError(const ChainSettings& settings) const
+    {
+        auto peak = makePeakFilter(settings, fitSampleRate);
+        auto highPass = makeHighPassFilter(settings, fitSampleRate);
+        auto lowPass = makeLowPassFilter(settings, fitSampleRate);
+
+        double error = 0;
+
+        for( int k = 0; k < NumFitPoints; ++k )
+        {
+            auto freq = fitFreqs[k];
+            double mag = peak->getMagnitudeForFrequency(freq, fitSampleRate);
+
+            for( int i = 0; i <= settings.highPassSlope; ++i )
+                mag *= highPass[i]->getMagnitudeForFrequency(freq, fitSampleRate);
+
+            for( int i = 0; i <= settings.lowPassSlope; ++i )
+                mag *= lowPass[i]->getMagnitudeForFrequency(freq, fitSampleRate);
+
+            auto delta = juce::Decibels::gainToDecibels(mag, -48.0) - target[k];
+            error += weights[k] * delta * delta;
+        }
+
+        return error;
+    }
+
+    /*
+     Nelder-Mead over the normalised parameter space.
+     */
+    template<typename ErrorFunction>
+    static FitParams minimise(const FitParams& start, double step, int maxIterations, ErrorFunction&& errorFor)
+    {
+        std::array<FitParams, NumFitParams + 1> simplex;
+        std::array<double, NumFitParams + 1> errors;
+
+        for( size_t i = 0; i < simplex.size(); ++i )
+        {
+            simplex[i] = start;
+            if( i > 0 )
+                simplex[i][i - 1] += (start[i - 1] + step > 1.0) ? -step : step;
+            errors[i] = errorFor(simplex[i]);
+        }
+
+        auto blend = [](const FitParams& a, const FitParams& b, double t)
+        {
+            FitParams r;
+            for( int i = 0; i < NumFitParams; ++i )
+                r[i] = juce::jlimit(0.0, 1.0, a[i] + t * (b[i] - a[i]));
+            return r;
+        };
+
+        for( int iteration = 0; iteration < maxIterations; ++iteration )
+        {
+            std::array<size_t, NumFitParams + 1> order;
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&errors](size_t a, size_t b) { return errors[a] < errors[b]; });
+
+            const auto best = order.front();
+            const auto worst = order.back();
+            const auto secondWorst = order[order.size() - 2];
+
+            if( errors[worst] - errors[best] < 1.0e-6 )
+                break;
+
+            FitParams centroid {};
+            for( size_t i = 0; i < simplex.size(); ++i )
+            {
+                if( i == worst )
+                    continue;
+                for( int d = 0; d < NumFitParams; ++d )
+                    centroid[d] += simplex[i][d] / double(NumFitParams);
+            }
+
+            auto reflected = blend(centroid, simplex[worst], -1.0);
+            auto reflectedError = errorFor(reflected);
+
+            if( reflectedError < errors[best] )
+            {
+                auto expanded = blend(centroid, simplex[worst], -2.0);
+                auto expandedError = errorFor(expanded);
+
+                if( expandedError < reflectedError )
+                {
+                    simplex[worst] = expanded;
+                    errors[worst] = expandedError;
+                }
+                else
+                {
+                    simplex[worst] = reflected;
+                    errors[worst] = reflectedError;
+                }
+            }
+            else if( reflectedError < errors[secondWorst] )
+            {
+                simplex[worst] = reflected;
+                errors[worst] = reflectedError;
+            }
+            else
+            {
+                auto contracted = blend(centroid, simplex[worst], 0.5);
+                auto contractedError = errorFor(contracted);
+
+                if( contractedError < errors[worst] )
+                {
+                    simplex[worst] = contracted;
+                    errors[worst] = contractedError;
+                }
+                else
+                {
+                    //shrink everything towards the best point
+                    for( size_t i = 0; i < simplex.size(); ++i )
+                    {
+                        if( i == best )
+                            continue;
+                        simplex[i] = blend(simplex[best], simplex[i], 0.5);
+                        errors[i] = errorFor(simplex[i]);
+                    }
+                }
+            }
+        }
+
+        auto bestIndex = std::distance(errors.begin(), std::min_element(errors.begin(), errors.end()));
+        return simplex[bestIndex];
+    }
+
+    void run() override
+    {
+        const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+        //start the peak on the biggest deviation between 40Hz and 16kHz
+        int peakIndex = 0;
+        for( int k = 0; k < NumFitPoints; ++k )
+        {
+            if( fitFreqs[k] >= 40.0 && fitFreqs[k] <= 16000.0
+               && std::abs(target[k]) > std::abs(target[peakIndex]) )
+                peakIndex = k;
+        }
+
+        FitParams params
+        {
+            0.0,
+            peakFreqRange.convertTo0to1((float)fitFreqs[peakIndex]),
+            peakGainRange.convertTo0to1((float)juce::jlimit(-24.0, 24.0, target[peakIndex])),
+            peakQualityRange.convertTo0to1(1.f),
+            1.0
+        };
+
+        auto highPassSlope = Slope::Slope_12;
+        auto lowPassSlope = Slope::Slope_12;
+
+        auto errorFor = [this, &highPassSlope, &lowPassSlope](const FitParams& p)
+        {
+            return getError(toChainSettings(p, highPassSlope, lowPassSlope));
+        };
+
+        params = minimise(params, 0.1, 300, errorFor);
+
+        if( threadShouldExit() )
+            return;
+
+        //the slopes are discrete: pick the best pair for the fitted frequencies, then polish
+        auto bestError = errorFor(params);
+        auto bestHighPassSlope = highPassSlope;
+        auto bestLowPassSlope = lowPassSlope;
+
+        for( int hp = Slope_12; hp <= Slope_48; ++hp )
+        {
+            for( int lp = Slope_12; lp <= Slope_48; ++lp )
+            {
+                highPassSlope = static_cast<Slope>(hp);
+                lowPassSlope = static_cast<Slope>(lp);
+
+                auto error = errorFor(params);
+                if( error < bestError )
+                {
+                    bestError = error;
+                    bestHighPassSlope = highPassSlope;
+                    bestLowPassSlope = lowPassSlope;
+                }
+            }
+        }
+
+        highPassSlope = bestHighPassSlope;
+        lowPassSlope = bestLowPassSlope;
+
+        params = minimise(params, 0.02, 100, errorFor);
+
+        if( threadShouldExit() )
+            return;
+
+        fittedSettings = toChainSettings(params, highPassSlope, lowPassSlope);
+        lastFitDurationMs = juce::Time::getMillisecondCounterHiRes() - startTime;
+
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        if( onFitComplete )
+            onFitComplete(fittedSettings);
+    }
+};
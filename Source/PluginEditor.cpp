@@ -8,6 +8,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "PresetLibrary.h"
 
 void LookAndFeel::drawRotarySlider(juce::Graphics &g,
                                    int x,
@@ -185,58 +186,459 @@ juce::Rectangle<int> RotarySliderWithLabels::getSliderBounds() const
 }
 
 //==========================================================================================
-ResponseCurveComponent::ResponseCurveComponent(JhanEQAudioProcessor& p) :
+SharedEditorResources::SharedEditorResources()
+{
+    //the colour map is looked up per pixel, so it's worked out once here
+    juce::ColourGradient colourMap(juce::Colours::black, 0.f, 0.f, juce::Colours::white, 1.f, 0.f, false);
+    colourMap.addColour(0.3, juce::Colours::darkblue);
+    colourMap.addColour(0.55, juce::Colours::purple);
+    colourMap.addColour(0.75, juce::Colours::red);
+    colourMap.addColour(0.9, juce::Colours::yellow);
+    
+    for( size_t i = 0; i < spectrogramColours.size(); ++i )
+        spectrogramColours[i] = colourMap.getColourAtPosition(double(i) / double(spectrogramColours.size() - 1)).getPixelARGB();
+}
+
+//==========================================================================================
+SpectrumAnalyzer::SpectrumAnalyzer(JhanEQAudioProcessor& p, MatchEQ& m) :
 audioProcessor(p),
-leftChannelFifo(&audioProcessor.leftChannelFifo)
+matchEQ(m),
+leftChannelRing(p.getAnalyzerRing(PostLeftTap))
 {
-    const auto& params = audioProcessor.getParameters();
-       for( auto param : params)
-       {
-           param->addListener(this);
-       }
+    //the match capture always listens to the left channel before the EQ
+    FFTDataGenerator<FFTFrame>::TraceSources matchSources;
+    matchSources[0].a = &audioProcessor.getAnalyzerRing(PreLeftTap);
+    matchFFTDataGenerator.setTraces(matchSources);
+    
+    setView(view, preEQ);
+}
+
+void SpectrumAnalyzer::prepareResources()
+{
+    const auto& plans = resources->getFFTPlans();
+    
+    viewFFTDataGenerator.prepare(plans);
+    matchFFTDataGenerator.prepare(plans);
+    lowBandFFTDataGenerator.prepare(plans);
+    transferFFTDataGenerator.prepare(plans);
+    transferFunction.prepare(FFTPlans::getMaxFFTSize() / 2);
+    
+    viewFFTData.bins.resize((size_t)FFTPlans::getMaxFFTSize() * 2, 0.f);
+    matchFFTData.bins.resize((size_t)FFTPlans::getMaxFFTSize() * 2, 0.f);
+    lowBandFFTData.bins.resize((size_t)FFTPlans::getMaxFFTSize() * 2, 0.f);
     
-    leftChannelFFTDataGenerator.changeOrder(FFTOrder::order2048);
-    monoBuffer.setSize(1, leftChannelFFTDataGenerator.getFFTSize());
+    //everything the low band needs is allocated here, switching it on later allocates nothing
+    for( auto& decimator : lowBandDecimators )
+        decimator.prepare(lowBandBlockSize);
     
-    updateChain();
+    for( auto& ring : lowBandRings )
+        ring.prepare(1 << FFTOrder::order8192);
     
-    startTimerHz(60);
+    lowBandInput.resize(lowBandBlockSize);
+    lowBandMix.resize(lowBandBlockSize);
+    
+    for( auto& pathProducer : pathProducers )
+        pathProducer.prepare(FFTPlans::getMaxFFTSize());
 }
 
-ResponseCurveComponent::~ResponseCurveComponent()
+void SpectrumAnalyzer::setBounds(juce::Rectangle<float> newBounds)
 {
-    const auto& params = audioProcessor.getParameters();
-    for( auto param : params)
+    const juce::SpinLock::ScopedLockType sl(boundsLock);
+    fftBounds = newBounds;
+}
+
+bool SpectrumAnalyzer::getPath(int trace, juce::Path& path)
+{
+    auto& pathProducer = pathProducers[(size_t)trace];
+    bool gotOne = false;
+    
+    //keep the newest path, handing the older ones straight back to the producer
+    while( pathProducer.getNumPathsAvailable() > 0 )
     {
-        param->removeListener(this);
+        gotOne = pathProducer.getPath(path) || gotOne;
     }
+    
+    return gotOne;
 }
 
-void ResponseCurveComponent::parameterValueChanged(int parameterIndex, float newValue)
+void SpectrumAnalyzer::setView(ChannelView newView, bool showPreEQ)
 {
-    parametersChanged.set(true);
+    view = newView;
+    preEQ = showPreEQ;
+    
+    auto& p = audioProcessor;
+    FFTDataGenerator<FFTFrame>::TraceSources sources;
+    
+    auto setChannels = [&](int firstTrace, AnalyzerTap leftTap, AnalyzerTap rightTap)
+    {
+        auto& first = sources[(size_t)firstTrace];
+        auto& second = sources[(size_t)firstTrace + 1];
+        
+        switch( view )
+        {
+            case ChannelView::Left:
+                first.a = &p.getAnalyzerRing(leftTap);
+                break;
+            case ChannelView::Stereo:
+                first.a = &p.getAnalyzerRing(leftTap);
+                second.a = &p.getAnalyzerRing(rightTap);
+                break;
+            case ChannelView::MidSide:
+                //mid = (L + R) / 2, side = (L - R) / 2
+                first = { &p.getAnalyzerRing(leftTap), &p.getAnalyzerRing(rightTap), 0.5f, 0.5f };
+                second = { &p.getAnalyzerRing(leftTap), &p.getAnalyzerRing(rightTap), 0.5f, -0.5f };
+                break;
+        }
+    };
+    
+    setChannels(0, PostLeftTap, PostRightTap);
+    
+    if( preEQ )
+        setChannels(2, PreLeftTap, PreRightTap);
+    
+    viewSources = sources;
+    viewFFTDataGenerator.setTraces(sources);
+    
+    //the low band decimates the same mixes into its own rings, then reads them as plain traces
+    FFTDataGenerator<FFTFrame>::TraceSources lowBandSources;
+    
+    for( size_t t = 0; t < sources.size(); ++t )
+        if( sources[t].a != nullptr )
+            lowBandSources[t].a = &lowBandRings[t];
+    
+    lowBandFFTDataGenerator.setTraces(lowBandSources);
+    lowBandPosition = -1;
+    lowBandFFTData.fftSize = 0;
+    
+    //paths of traces that just went away would otherwise show up again later
+    juce::Path stale;
+    for( auto& pathProducer : pathProducers )
+        while( pathProducer.getNumPathsAvailable() > 0 )
+            pathProducer.getPath(stale);
 }
 
-void ResponseCurveComponent::timerCallback()
+int SpectrumAnalyzer::getTaps() const
+{
+    const auto stereo = view != ChannelView::Left;
+    
+    auto taps = PostLeftTap | (stereo ? PostRightTap : 0);
+    
+    if( preEQ )
+        taps |= PreLeftTap | (stereo ? PreRightTap : 0);
+    
+    if( measuring || capturing )
+        taps |= PreLeftTap;
+    
+    if( measuring )
+        taps |= UncompensatedLeftTap;
+    
+    return taps;
+}
+
+int SpectrumAnalyzer::getTraces() const
+{
+    const auto post = view != ChannelView::Left ? 0b11 : 0b01;
+    return preEQ ? post | (post << 2) : post;
+}
+
+void SpectrumAnalyzer::setResolution(FFTOrder order, int zeroPadFactor)
+{
+    pendingOrder = order;
+    pendingZeroPadFactor = zeroPadFactor;
+}
+
+void SpectrumAnalyzer::setMode(SpectrumKernel::Mode mode)
+{
+    pendingMode = mode;
+}
+
+void SpectrumAnalyzer::setSmoothing(int octaveFraction)
+{
+    pendingSmoothing = octaveFraction;
+}
+
+void SpectrumAnalyzer::setMultiResolution(bool shouldBeOn)
+{
+    pendingMultiResolution = shouldBeOn;
+}
+
+void SpectrumAnalyzer::setSpectrogram(double historySeconds, int numRows)
+{
+    pendingSpectrogramSeconds = historySeconds;
+    pendingSpectrogramRows = numRows;
+}
+
+bool SpectrumAnalyzer::getSpectrogramRow(std::vector<juce::uint8>& row)
+{
+    return spectrogramRows.pull(row);
+}
+
+void SpectrumAnalyzer::setMeasuring(bool shouldMeasure)
+{
+    measuring = shouldMeasure;
+    
+    FFTDataGenerator<FFTFrame>::TraceSources sources;
+    
+    if( measuring )
+    {
+        //the output before auto gain, so H is the EQ's response and nothing else
+        sources[0].a = &audioProcessor.getAnalyzerRing(PreLeftTap);
+        sources[1].a = &audioProcessor.getAnalyzerRing(UncompensatedLeftTap);
+    }
+    
+    transferFFTDataGenerator.setTraces(sources);
+    transferFunction.reset();
+    
+    TransferPaths stale;
+    while( transferPathFifo.pull(stale) ) { }
+}
+
+bool SpectrumAnalyzer::getTransferPaths(TransferPaths& paths)
+{
+    bool gotOne = false;
+    
+    //keep the newest, handing the older ones straight back
+    while( transferPathFifo.getNumAvailableForReading() > 0 )
+        gotOne = transferPathFifo.pull(paths) || gotOne;
+    
+    return gotOne;
+}
+
+void SpectrumAnalyzer::generateTransferPaths(juce::Rectangle<float> bounds, double sampleRate)
+{
+    const auto width = juce::jmax(1, (int)bounds.getWidth());
+    
+    transferFunction.setColumns(width, sampleRate / transferFFTDataGenerator.getFFTSize(), 20.0, 20000.0);
+    transferLevels.resize((size_t)width);
+    transferCoherence.resize((size_t)width);
+    transferFunction.getColumns(transferLevels.data(), transferCoherence.data(), -48.f);
+    
+    const auto top = bounds.getY();
+    const auto bottom = bounds.getBottom();
+    const auto coherenceTop = bottom - 0.25f * bounds.getHeight();
+    
+    //reuses whatever storage the last push handed back
+    auto& response = transferPaths.response;
+    auto& coherence = transferPaths.coherence;
+    response.clear();
+    coherence.clear();
+    response.preallocateSpace(3 * width);
+    coherence.preallocateSpace(3 * width);
+    
+    bool drawing = false;
+    
+    for( int x = 0; x < width; ++x )
+    {
+        const auto y = juce::jmap(juce::jlimit(-24.f, 24.f, transferLevels[(size_t)x]), -24.f, 24.f, bottom, top);
+        const auto coherenceY = juce::jmap(transferCoherence[(size_t)x], 0.f, 1.f, bottom, coherenceTop);
+        
+        if( x == 0 )
+            coherence.startNewSubPath(0.f, coherenceY);
+        else
+            coherence.lineTo((float)x, coherenceY);
+        
+        //where the output isn't explained by the input the measurement means nothing, so it's left out
+        if( transferCoherence[(size_t)x] < minCoherence )
+        {
+            drawing = false;
+            continue;
+        }
+        
+        if( drawing )
+            response.lineTo((float)x, y);
+        else
+            response.startNewSubPath((float)x, y);
+        
+        drawing = true;
+    }
+    
+    transferPathFifo.push(transferPaths);
+}
+
+void SpectrumAnalyzer::addToSpectrogram(const std::vector<float>& levels, SampleRing::Position frameEnd, double sampleRate, float negativeInfinity)
+{
+    if( pendingSpectrogramSeconds != spectrogramSeconds || pendingSpectrogramRows != spectrogramNumRows )
+    {
+        spectrogramSeconds = pendingSpectrogramSeconds;
+        spectrogramNumRows = pendingSpectrogramRows;
+        spectrogramRowStart = -1;
+    }
+    
+    if( spectrogramSeconds <= 0.0 || spectrogramNumRows <= 0 || sampleRate <= 0.0 )
+        return;
+    
+    const auto width = (int)levels.size();
+    
+    if( spectrogramRowStart < 0 || (int)spectrogramLevels.size() != width )
+    {
+        spectrogramLevels.assign((size_t)width, negativeInfinity);
+        spectrogramRowStart = frameEnd;
+    }
+    
+    juce::FloatVectorOperations::max(spectrogramLevels.data(), spectrogramLevels.data(), levels.data(), width);
+    
+    const auto rowLength = spectrogramSeconds * sampleRate / spectrogramNumRows;
+    
+    if( double(frameEnd - spectrogramRowStart) < rowLength )
+        return;
+    
+    spectrogramRow.resize((size_t)width);
+    const auto scale = 255.f / -negativeInfinity;
+    
+    for( int x = 0; x < width; ++x )
+        spectrogramRow[(size_t)x] = (juce::uint8)juce::jlimit(0, 255, juce::roundToInt((spectrogramLevels[(size_t)x] - negativeInfinity) * scale));
+    
+    //if the message thread is behind, the row is dropped rather than waited for
+    spectrogramRows.push(spectrogramRow);
+    
+    std::fill(spectrogramLevels.begin(), spectrogramLevels.end(), negativeInfinity);
+    spectrogramRowStart = frameEnd;
+}
+
+void SpectrumAnalyzer::decimateLowBand(double sampleRate)
 {
+    if( sampleRate <= 0.0 )
+        return;
     
-    juce::AudioBuffer<float> tempIncomingBuffer;
+    const auto numStages = juce::jlimit(0, HalfBandDecimator::maxNumStages, juce::roundToInt(std::log2(sampleRate / lowBandTargetRate)));
+    const auto factor = 1 << numStages;
+    
+    if( sampleRate / factor != lowBandSampleRate )
+        lowBandPosition = -1;
+    
+    const auto end = leftChannelRing.getWritePosition();
+    
+    //first time, new rate, or we fell too far behind: start over from one low band window back
+    if( lowBandPosition < 0 || lowBandPosition < end - leftChannelRing.getCapacity() / 2 )
+    {
+        auto history = juce::jmin<SampleRing::Position>((SampleRing::Position)lowBandFFTDataGenerator.getWindowSize() * factor,
+                                                        leftChannelRing.getCapacity() / 2);
+        lowBandPosition = juce::jmax<SampleRing::Position>(0, end - history);
+        lowBandPosition -= lowBandPosition % factor;
+        lowBandSampleRate = sampleRate / factor;
+        
+        for( size_t t = 0; t < lowBandRings.size(); ++t )
+        {
+            lowBandDecimators[t].setNumStages(numStages);
+            
+            //clears whatever an earlier run left behind, without reallocating
+            lowBandRings[t].prepare(lowBandRings[t].getCapacity());
+            lowBandRings[t].setWritePosition(lowBandPosition / factor);
+        }
+    }
     
-    while( leftChannelFifo->getNumCompleteBuffersAvailable() > 0)
+    while( end - lowBandPosition >= factor )
     {
-        if( leftChannelFifo->getAudioBuffer(tempIncomingBuffer) )
+        auto numSamples = (int)juce::jmin<SampleRing::Position>(end - lowBandPosition, lowBandBlockSize);
+        numSamples -= numSamples % factor;
+        
+        for( size_t t = 0; t < viewSources.size(); ++t )
         {
-            auto size = tempIncomingBuffer.getNumSamples();
+            const auto& source = viewSources[t];
+            
+            if( source.a == nullptr )
+                continue;
+            
+            auto* input = lowBandInput.data();
+            bool valid = source.a->copy(lowBandPosition, numSamples, input);
             
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, 0),
-                                              monoBuffer.getReadPointer(0, size),
-                                              monoBuffer.getNumSamples() - size);
+            if( source.gainA != 1.f )
+                juce::FloatVectorOperations::multiply(input, source.gainA, numSamples);
             
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, monoBuffer.getNumSamples() - size),
-                                              tempIncomingBuffer.getReadPointer(0, 0),
-                                              size);
+            if( source.b != nullptr )
+            {
+                valid = source.b->copy(lowBandPosition, numSamples, lowBandMix.data()) && valid;
+                juce::FloatVectorOperations::addWithMultiply(input, lowBandMix.data(), source.gainB, numSamples);
+            }
+            
+            //a gap in the input would leave a click in the filter state, so start again
+            if( ! valid )
+            {
+                lowBandPosition = -1;
+                return;
+            }
+            
+            auto numOut = lowBandDecimators[t].process(input, numSamples, input);
+            lowBandRings[t].push(input, numOut);
+        }
+        
+        lowBandPosition += numSamples;
+    }
+}
+
+double SpectrumAnalyzer::analyze()
+{
+    //an editor open on a stopped transport never pays for any of it
+    if( ! viewFFTDataGenerator.isPrepared() )
+    {
+        if( leftChannelRing.getNumUnread() == 0 )
+            return 50.0;
+        
+        prepareResources();
+    }
+    
+    if( pendingMultiResolution != multiResolution )
+    {
+        multiResolution = pendingMultiResolution;
+        lowBandPosition = -1;
+        lowBandFFTData.fftSize = 0;
+    }
+    
+    if( pendingOrder != currentOrder || pendingZeroPadFactor != currentZeroPadFactor )
+    {
+        currentOrder = pendingOrder;
+        currentZeroPadFactor = pendingZeroPadFactor;
+        
+        viewFFTDataGenerator.setResolution(static_cast<FFTOrder>(currentOrder), currentZeroPadFactor);
+        transferFFTDataGenerator.setResolution(static_cast<FFTOrder>(currentOrder), currentZeroPadFactor);
+        lowBandFFTDataGenerator.setResolution(FFTOrder::order2048, currentZeroPadFactor);
+        matchFFTDataGenerator.setResolution(static_cast<FFTOrder>(currentOrder), currentZeroPadFactor);
+    }
+    
+    //the match capture wants raw frames, only the display is averaged
+    viewFFTDataGenerator.setMode(pendingMode);
+    lowBandFFTDataGenerator.setMode(pendingMode);
+    
+    for( auto& pathProducer : pathProducers )
+        pathProducer.setSmoothing(pendingSmoothing);
+    
+    const auto sampleRate = audioProcessor.getSampleRate();
+    const auto windowSize = viewFFTDataGenerator.getWindowSize();
+    const auto numFrames = fftScheduler.schedule(leftChannelRing, windowSize);
+    
+    if( multiResolution && numFrames > 0 )
+        decimateLowBand(sampleRate);
+    
+    bool transferChanged = false;
+    
+    for( int i = 0; i < numFrames; ++i )
+    {
+        auto windowStart = fftScheduler.getNextWindow(leftChannelRing, windowSize);
+        
+        //every tap is pushed in the same callback from the same position, so one window start fits them all
+        if( ! viewFFTDataGenerator.produceFFTDataForRendering(windowStart, sampleRate, -48.f) )
+            continue;
+        
+        //the same windows as the display, so the measurement costs at most one FFT per frame
+        if( measuring )
+            transferChanged = transferFFTDataGenerator.produceTransferFunction(windowStart, sampleRate, transferFunction) || transferChanged;
+        
+        //the low band window ends where this one does. the kernel normalizes by window length,
+        //so a tone reads the same level in both bands whatever their sample rates
+        if( multiResolution && lowBandPosition >= 0 )
+        {
+            const auto factor = lowBandDecimators[0].getFactor();
+            const auto lowBandWindowEnd = juce::jmax<SampleRing::Position>(0, windowStart + windowSize) / factor;
             
-            leftChannelFFTDataGenerator.produceFFTDataForRendering(monoBuffer, -48.f);
+            lowBandFFTDataGenerator.produceFFTDataForRendering(lowBandWindowEnd - lowBandFFTDataGenerator.getWindowSize(),
+                                                               lowBandSampleRate, -48.f);
+        }
+        
+        if( matchEQ.getCapture() != MatchEQ::Capture::None )
+        {
+            if( matchFFTDataGenerator.produceFFTDataForRendering(windowStart, sampleRate, -120.f)
+               && matchFFTDataGenerator.getFFTData(matchFFTData) )
+                matchEQ.addFrame(matchFFTData.bins, matchFFTData.fftSize, sampleRate);
         }
     }
     
@@ -246,265 +648,1138 @@ void ResponseCurveComponent::timerCallback()
             generate a path
      */
     
-    const auto fftBounds = getAnalysisArea().toFloat();
-    const auto fftSize = leftChannelFFTDataGenerator.getFFTSize();
+    juce::Rectangle<float> bounds;
+    {
+        const juce::SpinLock::ScopedLockType sl(boundsLock);
+        bounds = fftBounds;
+    }
     
-    /*
-     48000 / 2048 = 23hz = <- this is the bin width
-     */
+    if( transferChanged && ! bounds.isEmpty() )
+        generateTransferPaths(bounds, sampleRate);
     
-    const auto binWidth = audioProcessor.getSampleRate() / (double)fftSize;
+    //the newest low band frame goes with every display frame until the next one arrives
+    while( lowBandFFTDataGenerator.getNumAvailableFFTDataBlocks() > 0 )
+        lowBandFFTDataGenerator.getFFTData(lowBandFFTData);
     
-    while (leftChannelFFTDataGenerator.getNumAvailableFFTDataBlocks() > 0)
+    const auto useLowBand = multiResolution && lowBandFFTData.fftSize > 0;
+    
+    while (viewFFTDataGenerator.getNumAvailableFFTDataBlocks() > 0)
     {
-        std::vector<float> fftData;
-        if( leftChannelFFTDataGenerator.getFFTData(fftData) )
+        if( viewFFTDataGenerator.getFFTData(viewFFTData) && ! bounds.isEmpty() )
         {
-            pathProducer.generatePath(fftData, fftBounds, fftSize, binWidth, -48.f);
+            //each frame carries its own size, so a resolution change can't mix them up
+            const auto fftSize = viewFFTData.fftSize;
+            
+            /*
+             48000 / 2048 = 23hz = <- this is the bin width
+             */
+            
+            const auto binWidth = sampleRate / (double)fftSize;
+            
+            for( int trace = 0; trace < FFTFrame::maxTraces; ++trace )
+            {
+                if( ! (viewFFTData.traces & (1 << trace)) )
+                    continue;
+                
+                AnalyzerPathGenerator<juce::Path>::Band band { viewFFTData.getTrace(trace), fftSize / 2, (float)binWidth }, lowBand;
+                
+                if( useLowBand && (lowBandFFTData.traces & (1 << trace)) )
+                    lowBand = { lowBandFFTData.getTrace(trace), lowBandFFTData.fftSize / 2, float(lowBandSampleRate / lowBandFFTData.fftSize) };
+                
+                pathProducers[(size_t)trace].generatePath(band, lowBand, lowBandCrossover, bounds, -48.f);
+            }
+            
+            //the spectrogram reuses the first trace's columns, so it lines up with the curve
+            addToSpectrogram(pathProducers[0].getLevels(), viewFFTData.windowEnd, sampleRate, -48.f);
         }
     }
     
+    return fftScheduler.getMillisecondsUntilNextFrame(leftChannelRing, windowSize, sampleRate);
+}
+
+//==========================================================================================
+ResponseCurveComponent::ResponseCurveComponent(JhanEQAudioProcessor& p) :
+audioProcessor(p)
+{
+    //paint() covers every pixel, so nothing behind needs repainting with us
+    setOpaque(true);
+    
+    const auto& params = audioProcessor.getParameters();
+       for( auto param : params)
+       {
+           param->addListener(this);
+       }
+    
+    //the rings have to exist before the analyzer thread starts reading them
+    audioProcessor.attachAnalyzer(analyzer.getTaps());
+    analyzerTraces = analyzer.getTraces();
     
-    if( parametersChanged.compareAndSetBool(false, true) )
-    {
-        DBG("params changed: ");
-        //update the monochain
+    if( ! pullChainSnapshot() )
         updateChain();
-        //signal a repaint
-        repaint();
+    
+    //leaving the initial suspended pace is what hands the analyzer to its thread
+    lastChangeMs = juce::Time::getMillisecondCounterHiRes();
+    setPace(Pace::Active);
+}
+
+ResponseCurveComponent::~ResponseCurveComponent()
+{
+   #if JUCE_MAJOR_VERSION >= 7
+    vBlankAttachment.reset();
+   #endif
+    
+    analyzerThread->removeClient(&analyzer);
+    audioProcessor.detachAnalyzer(analyzer.getTaps());
+    
+    const auto& params = audioProcessor.getParameters();
+    for( auto param : params)
+    {
+        param->removeListener(this);
     }
 }
 
-void ResponseCurveComponent::updateChain()
+void ResponseCurveComponent::setAnalyzerView(SpectrumAnalyzer::ChannelView view, bool showPreEQ)
+{
+    //the analyzer can't be reading a ring while the taps change under it
+    analyzerThread->removeClient(&analyzer);
+    
+    //attach before detaching, so taps both views share never drop out
+    const auto oldTaps = analyzer.getTaps();
+    analyzer.setView(view, showPreEQ);
+    audioProcessor.attachAnalyzer(analyzer.getTaps());
+    audioProcessor.detachAnalyzer(oldTaps);
+    
+    analyzerTraces = analyzer.getTraces();
+    
+    for( int trace = 0; trace < FFTFrame::maxTraces; ++trace )
+        if( ! (analyzerTraces & (1 << trace)) )
+            analyzerPaths[(size_t)trace].clear();
+    
+    //a suspended display picks the analyzer back up when it's showing again
+    if( pace != Pace::Suspended )
+        analyzerThread->addClient(&analyzer);
+    
+    repaint(getAnalysisArea());
+}
+
+void ResponseCurveComponent::setTransferMeasurement(bool shouldMeasure)
+{
+    if( shouldMeasure == analyzer.isMeasuring() )
+        return;
+    
+    //the same dance as a view change: the measurement needs the pre EQ tap
+    analyzerThread->removeClient(&analyzer);
+    
+    const auto oldTaps = analyzer.getTaps();
+    analyzer.setMeasuring(shouldMeasure);
+    audioProcessor.attachAnalyzer(analyzer.getTaps());
+    audioProcessor.detachAnalyzer(oldTaps);
+    
+    measuredPaths.response.clear();
+    measuredPaths.coherence.clear();
+    
+    if( pace != Pace::Suspended )
+        analyzerThread->addClient(&analyzer);
+    
+    repaint(getAnalysisArea());
+}
+
+void ResponseCurveComponent::setMatchCapture(MatchEQ::Capture capture)
+{
+    const auto capturing = capture != MatchEQ::Capture::None;
+    
+    //the tap is attached before the capture starts and the capture stops before the tap goes
+    analyzerThread->removeClient(&analyzer);
+    
+    const auto oldTaps = analyzer.getTaps();
+    analyzer.setCapturing(capturing);
+    audioProcessor.attachAnalyzer(analyzer.getTaps());
+    matchEQ.setCapture(capture);
+    audioProcessor.detachAnalyzer(oldTaps);
+    
+    if( pace != Pace::Suspended )
+        analyzerThread->addClient(&analyzer);
+}
+
+void ResponseCurveComponent::setSpectrogramHistory(double seconds)
+{
+    spectrogramSeconds = seconds;
+    
+    //a new time scale starts from a clean image
+    if( spectrogram.isValid() )
+        spectrogram.clear(spectrogram.getBounds());
+    
+    analyzer.setSpectrogram(spectrogramSeconds, spectrogram.isValid() ? spectrogram.getHeight() : 0);
+}
+
+void ResponseCurveComponent::drawSpectrogramRow(const std::vector<juce::uint8>& row)
+{
+    const auto width = juce::jmin(spectrogram.getWidth(), (int)row.size());
+    
+    //the newest row replaces the oldest, nothing else in the image is touched
+    spectrogramNewestRow = (spectrogramNewestRow + spectrogram.getHeight() - 1) % spectrogram.getHeight();
+    
+    juce::Image::BitmapData data(spectrogram, 0, spectrogramNewestRow, spectrogram.getWidth(), 1, juce::Image::BitmapData::writeOnly);
+    jassert( data.pixelFormat == juce::Image::RGB );
+    
+    auto* line = data.getLinePointer(0);
+    
+    for( int x = 0; x < width; ++x )
+        reinterpret_cast<juce::PixelRGB*>(line + x * data.pixelStride)->set(resources->spectrogramColours[row[(size_t)x]]);
+}
+
+void ResponseCurveComponent::parameterValueChanged(int parameterIndex, float newValue)
+{
+    parametersChanged.set(true);
+    
+    //automation arrives on the audio thread and waits for the next idle tick,
+    //but a slider being dragged shouldn't have to
+    if( juce::MessageManager::existsAndIsCurrentThread() && pace == Pace::Idle )
+    {
+        lastChangeMs = juce::Time::getMillisecondCounterHiRes();
+        setPace(Pace::Active);
+    }
+}
+
+void ResponseCurveComponent::visibilityChanged()
+{
+    resumeIfShowing();
+}
+
+void ResponseCurveComponent::parentHierarchyChanged()
+{
+    resumeIfShowing();
+}
+
+void ResponseCurveComponent::resumeIfShowing()
+{
+    //un-minimising doesn't call either of the above, the suspended timer catches that
+    if( pace == Pace::Suspended && isShowing() )
+    {
+        lastChangeMs = juce::Time::getMillisecondCounterHiRes();
+        setPace(Pace::Active);
+    }
+}
+
+void ResponseCurveComponent::setMaxFrameRate(int framesPerSecond)
+{
+    maxFrameRate = juce::jlimit(idleFrameRate, 240, framesPerSecond);
+    
+    if( pace != Pace::Idle )
+        analyzer.setMaxFramesPerSecond(maxFrameRate);
+    
+   #if JUCE_MAJOR_VERSION < 7
+    //with vblank sync the callback checks maxFrameRate itself
+    if( pace == Pace::Active )
+        startTimerHz(maxFrameRate);
+   #endif
+}
+
+void ResponseCurveComponent::setResponseCurves(int curves)
+{
+    if( curves == responseCurves )
+        return;
+    
+    responseCurves = curves;
+    updateResponseCurve(false);
+    curveLayer.invalidate();
+    repaint(getRenderArea());
+}
+
+void ResponseCurveComponent::setPace(Pace newPace)
+{
+    if( newPace == pace )
+        return;
+    
+    if( newPace == Pace::Suspended )
+        analyzerThread->removeClient(&analyzer);
+    else if( pace == Pace::Suspended )
+        analyzerThread->addClient(&analyzer);
+    
+    pace = newPace;
+    
+    //no more FFTs than the display is going to draw
+    analyzer.setMaxFramesPerSecond(pace == Pace::Idle ? idleFrameRate : maxFrameRate);
+    
+   #if JUCE_MAJOR_VERSION >= 7
+    if( pace == Pace::Active )
+    {
+        stopTimer();
+        vBlankAttachment = std::make_unique<juce::VBlankAttachment>(this, [this]
+        {
+            //vblanks come at the display's rate, frames are dropped down to maxFrameRate.
+            //the millisecond of slack keeps a 60 fps limit from skipping every other 60 Hz vblank
+            auto now = juce::Time::getMillisecondCounterHiRes();
+            
+            if( now - lastFrameMs >= 1000.0 / maxFrameRate - 1.0 )
+            {
+                lastFrameMs = now;
+                refresh();
+            }
+        });
+        return;
+    }
+    
+    vBlankAttachment.reset();
+   #endif
+    
+    startTimerHz(pace == Pace::Active ? maxFrameRate : pace == Pace::Idle ? idleFrameRate : suspendedFrameRate);
+}
+
+void ResponseCurveComponent::parameterGestureChanged(int parameterIndex, bool gestureIsStarting)
+{
+    numGesturesInProgress += gestureIsStarting ? 1 : -1;
+}
+
+void ResponseCurveComponent::timerCallback()
+{
+    refresh();
+}
+
+void ResponseCurveComponent::refresh()
+{
+    //nothing is drained or drawn while nobody can see it
+    if( ! isShowing() )
+    {
+        setPace(Pace::Suspended);
+        return;
+    }
+    
+    //all the analysis happens on the analyzer thread, we only pick up what it finished
+    bool analyzerChanged = false;
+    
+    for( int trace = 0; trace < FFTFrame::maxTraces; ++trace )
+        if( analyzerTraces & (1 << trace) )
+            analyzerChanged = analyzer.getPath(trace, analyzerPaths[(size_t)trace]) || analyzerChanged;
+    
+    if( analyzer.isMeasuring() )
+        analyzerChanged = analyzer.getTransferPaths(measuredPaths) || analyzerChanged;
+    
+    bool spectrogramChanged = false;
+    
+    while( analyzer.getSpectrogramRow(spectrogramData) )
+    {
+        if( spectrogram.isValid() )
+        {
+            drawSpectrogramRow(spectrogramData);
+            spectrogramChanged = true;
+        }
+    }
+    
+    const bool isDragging = numGesturesInProgress.load() > 0;
+    bool curveChanged = false;
+    
+    if( parametersChanged.compareAndSetBool(false, true) && parametersChangedMs == 0.0 )
+        parametersChangedMs = juce::Time::getMillisecondCounterHiRes();
+    
+    if( pullChainSnapshot() )
+    {
+        parametersChangedMs = 0.0;
+        updateResponseCurve(isDragging);
+        curveChanged = true;
+    }
+    else if( parametersChangedMs > 0.0 && juce::Time::getMillisecondCounterHiRes() - parametersChangedMs > snapshotTimeoutMs )
+    {
+        //the parameters moved but processBlock isn't running to pick them up
+        parametersChangedMs = 0.0;
+        updateChain();
+        updateResponseCurve(isDragging);
+        curveChanged = true;
+    }
+    else if( responseCurveIsCoarse && ! isDragging )
+    {
+        //the drag is over, fill in the columns in between
+        updateResponseCurve(false);
+        curveChanged = true;
+    }
+    
+    //each layer only repaints the region it covers. the analyzer on its own never
+    //re-rasterizes the grid or the curve, it's composited between their cached images
+    if( curveChanged )
+    {
+        curveLayer.invalidate();
+        repaint(getRenderArea());
+    }
+    else if( analyzerChanged )
+    {
+        repaint(getAnalysisArea());
+    }
+    
+    if( spectrogramChanged )
+        repaint(getSpectrogramArea());
+    
+    const auto now = juce::Time::getMillisecondCounterHiRes();
+    
+    //coming back from suspended counts as a change, so it starts out at full rate
+    if( analyzerChanged || spectrogramChanged || curveChanged || pace == Pace::Suspended )
+        lastChangeMs = now;
+    
+    setPace(now - lastChangeMs > idleAfterMs ? Pace::Idle : Pace::Active);
+}
+
+bool ResponseCurveComponent::pullChainSnapshot()
+{
+    ChainSnapshot snapshot;
+    
+    if( ! audioProcessor.getChainSnapshot().readIfNewer(snapshot, chainVersion) )
+        return false;
+    
+    chainCoefficients = snapshot.coefficients;
+    chainSampleRate = snapshot.sampleRate;
+    return true;
+}
+
+void ResponseCurveComponent::updateChain()
+{
+    //the same designs the audio thread runs, without building any Coefficients objects
+    chainSampleRate = audioProcessor.getSampleRate();
+    chainCoefficients = makeChainCoefficients(getChainSettings(audioProcessor.apvts), chainSampleRate);
+}
+
+void ResponseCurveComponent::updateResponseCurve(bool coarse)
+{
+    using namespace juce;
+    
+    auto responseArea = getAnalysisArea();
+    responseCurve.clear();
+    phaseCurve.clear();
+    groupDelayCurve.clear();
+    responseCurveIsCoarse = coarse;
+    
+    if( responseArea.isEmpty() || chainSampleRate <= 0.0 )
+        return;
+    
+    if( ! responseKernel.matches(responseArea.getWidth(), chainSampleRate) )
+        responseKernel.setColumns(responseArea.getWidth(), chainSampleRate, 20.0, 20000.0);
+    
+    //the peak is always on, the pass filters use one section per 12 dB/oct
+    std::array<ResponseKernel::Section, 9> sections;
+    int numSections = 0;
+    
+    sections[(size_t)numSections++] = chainCoefficients.peak;
+    
+    for( int i = 0; i <= chainCoefficients.highPassSlope; ++i )
+        sections[(size_t)numSections++] = chainCoefficients.highPass[(size_t)i];
+    
+    for( int i = 0; i <= chainCoefficients.lowPassSlope; ++i )
+        sections[(size_t)numSections++] = chainCoefficients.lowPass[(size_t)i];
+    
+    auto points = responseKernel.process(sections.data(), numSections, coarse, responseCurves);
+    
+    const float outputMin = responseArea.getBottom();
+    const float outputMax = responseArea.getY();
+    auto map = [outputMin, outputMax](float input)
+    {
+        return jmap(input, -24.f, 24.f, outputMin, outputMax);
+    };
+    
+    responseCurve.preallocateSpace(3 * points.size);
+    responseCurve.startNewSubPath(responseArea.getX() + points.columns[0], map(points.decibels[0]));
+    
+    for( int i = 1; i < points.size; ++i )
+        responseCurve.lineTo(responseArea.getX() + points.columns[i], map(points.decibels[i]));
+    
+    auto makeCurve = [&](Path& curve, const float* values, float minimum, float maximum)
+    {
+        curve.preallocateSpace(3 * points.size);
+        curve.startNewSubPath(responseArea.getX() + points.columns[0], jmap(values[0], minimum, maximum, outputMin, outputMax));
+        
+        for( int i = 1; i < points.size; ++i )
+            curve.lineTo(responseArea.getX() + points.columns[i], jmap(values[i], minimum, maximum, outputMin, outputMax));
+    };
+    
+    if( points.phase != nullptr )
+    {
+        auto peak = 0.f;
+        
+        for( int i = 0; i < points.size; ++i )
+            peak = jmax(peak, std::abs(points.phase[i]));
+        
+        phaseRange = MathConstants<float>::pi * jmax(1.f, std::ceil(peak / MathConstants<float>::pi - 0.01f));
+        makeCurve(phaseCurve, points.phase, -phaseRange, phaseRange);
+    }
+    
+    if( points.groupDelay != nullptr )
+    {
+        auto peak = 0.f;
+        
+        for( int i = 0; i < points.size; ++i )
+            peak = jmax(peak, points.groupDelay[i]);
+        
+        groupDelayRange = 1.f;
+        
+        for( auto decade = 1.f; groupDelayRange < peak; decade *= 10.f )
+            for( auto step : { 1.f, 2.f, 5.f } )
+                if( groupDelayRange < peak )
+                    groupDelayRange = step * decade;
+        
+        makeCurve(groupDelayCurve, points.groupDelay, 0.f, groupDelayRange);
+    }
+}
+
+void ResponseCurveComponent::paint (juce::Graphics& g)
+{
+    
+    using namespace juce;
+    // (Our component is opaque, so we must completely fill the background with a solid colour)
+    g.fillAll (Colours::black);
+    
+    //only what's inside the clip gets composited, so a repaint of the analysis area
+    //doesn't touch the rest of either layer
+    gridLayer.draw(g, getLocalBounds(), true, [this](Graphics& gg) { drawGrid(gg); });
+    
+    auto responseArea = getAnalysisArea();
+    
+    {
+        Graphics::ScopedSaveState state(g);
+        g.reduceClipRegion(responseArea);
+        
+        const auto translation = AffineTransform::translation((float)responseArea.getX(), 0.f);
+        
+        //left / mid in blue, right / side in orange, the pre-EQ traces dimmed underneath
+        const Colour traceColours[] { Colours::skyblue, Colours::orange };
+        
+        for( int trace = FFTFrame::maxTraces - 1; trace >= 0; --trace )
+        {
+            if( ! (analyzerTraces & (1 << trace)) )
+                continue;
+            
+            const bool isPreEQ = trace >= 2;
+            g.setColour(traceColours[trace & 1].withAlpha(isPreEQ ? 0.35f : 1.f));
+            g.strokePath(analyzerPaths[(size_t)trace], PathStrokeType(1.f), translation);
+        }
+    }
+    
+    if( spectrogram.isValid() )
+    {
+        //newest row at the top. the ring is drawn as two pieces instead of being shifted
+        auto area = getSpectrogramArea();
+        auto newest = spectrogramNewestRow;
+        auto height = spectrogram.getHeight();
+        auto width = spectrogram.getWidth();
+        
+        g.drawImage(spectrogram, area.getX(), area.getY(), width, height - newest, 0, newest, width, height - newest);
+        
+        if( newest > 0 )
+            g.drawImage(spectrogram, area.getX(), area.getY() + height - newest, width, newest, 0, 0, width, newest);
+    }
+    
+    curveLayer.draw(g, getRenderArea(), false, [this](Graphics& gg)
+    {
+        //the scales go in the top right corner, one line each
+        auto labelArea = getAnalysisArea().reduced(4, 2).removeFromRight(80);
+        gg.setFont(10);
+        
+        if( ! phaseCurve.isEmpty() )
+        {
+            gg.setColour(Colours::violet);
+            gg.strokePath(phaseCurve, PathStrokeType(1.f));
+            gg.drawFittedText(String::charToString(0xb1) + String(roundToInt(radiansToDegrees(phaseRange))) + String::charToString(0xb0),
+                              labelArea.removeFromTop(12), Justification::centredRight, 1);
+        }
+        
+        if( ! groupDelayCurve.isEmpty() )
+        {
+            gg.setColour(Colours::yellow);
+            gg.strokePath(groupDelayCurve, PathStrokeType(1.f));
+            gg.drawFittedText("0 - " + String(roundToInt(groupDelayRange)) + " ms", labelArea.removeFromTop(12), Justification::centredRight, 1);
+        }
+        
+        gg.setColour(Colours::white);
+        gg.strokePath(responseCurve, PathStrokeType(2.f));
+    });
+    
+    //the measurement goes over the designed curve it's being compared with
+    if( analyzer.isMeasuring() )
+    {
+        Graphics::ScopedSaveState state(g);
+        g.reduceClipRegion(responseArea);
+        
+        const auto translation = AffineTransform::translation((float)responseArea.getX(), 0.f);
+        
+        g.setColour(Colours::limegreen.withAlpha(0.4f));
+        g.strokePath(measuredPaths.coherence, PathStrokeType(1.f), translation);
+        g.setColour(Colours::limegreen);
+        g.strokePath(measuredPaths.response, PathStrokeType(1.5f), translation);
+    }
+}
+
+void ResponseCurveComponent::drawGrid(juce::Graphics& g)
+{
+    using namespace juce;
+    
+    Array<float> freqs
+    {
+        20, /*30, 40,*/ 50, 100,
+        200, /*300, 400,*/ 500, 1000,
+        2000, /*3000, 4000,*/ 5000, 10000,
+        20000
+    };
+    
+    auto renderArea = getAnalysisArea();
+    auto left = renderArea.getX();
+    auto right = renderArea.getRight();
+    auto top = renderArea.getY();
+    auto bottom = renderArea.getBottom();
+    auto width = renderArea.getWidth();
+    
+    Array<float> xs;
+    for( auto f : freqs )
+    {
+        auto normX = mapFromLog10(f, 20.f, 20000.f);
+        xs.add(left + width * normX);
+    }
+    
+    g.setColour(Colours::dimgrey);
+
+    for( auto x : xs)
+    {
+        g.drawVerticalLine(x, top, bottom);
+    }
+    
+    Array<float> gain
+    {
+        -24, -12, 0, 12, 24
+    };
+    
+    for( auto gDb : gain)
+    {
+        auto y = jmap(gDb, -24.f,  24.f, float(bottom), float(top));
+        g.setColour(gDb == 0.f ? Colour(137u, 203u, 178u) : Colours::darkgrey );
+        g.drawHorizontalLine(y, left, right);
+        
+    }
+    
+//    g.drawRect(getAnalysisArea());
+    
+    g.setColour(Colours::lightgrey);
+    const int fontHeight = 10;
+    g.setFont(fontHeight);
+    
+    for( int i = 0; i < freqs.size(); ++i)
+    {
+        auto f = freqs[i];
+        auto x = xs[i];
+        
+        bool addK = false;
+        String str;
+        if( f > 999.f)
+        {
+            addK = true;
+            f /= 1000.f;
+        }
+        
+        str << f;
+        if ( addK )
+            str << "k";
+        str << "Hz";
+        
+        auto textWidth = g.getCurrentFont().getStringWidth(str);
+        
+        Rectangle<int> r;
+        r.setSize(textWidth, fontHeight);
+        r.setCentre(x, 0);
+        r.setY(1);
+    
+        g.drawFittedText(str, r, juce::Justification::centred, 1);
+    }
+    
+    //gain dB Text
+    for( auto gDb : gain)
+    {
+        auto y = jmap(gDb, -24.f,  24.f, float(bottom), float(top));
+        
+        String str;
+        if (gDb > 0)
+            str << "+";
+        str << gDb;
+        
+        auto textWidth = g.getCurrentFont().getStringWidth(str);
+        
+        Rectangle<int> r;
+        r.setSize(textWidth, fontHeight);
+        r.setX(getWidth() - textWidth);
+        r.setCentre(r.getCentreX(), y);
+        
+        g.setColour(gDb == 0.f ? Colour(137u, 203u, 178u) : Colours::lightgrey );
+        
+        g.drawFittedText(str, r, juce::Justification::centred, 1);
+        
+        
+        //slope Text
+        str.clear();
+        str << (gDb - 24.f);
+        
+        r.setX(1);
+        textWidth = g.getCurrentFont().getStringWidth(str);
+        r.setSize(textWidth, fontHeight);
+        g.setColour(Colours::lightgrey);
+        g.drawFittedText(str, r, juce::Justification::centred, 1);
+    }
+    
+    g.setColour(Colours::orange);
+    g.drawRoundedRectangle(getRenderArea().toFloat(), 4.f, 1.f);
+}
+
+void ResponseCurveComponent::resized()
+{
+    using namespace juce;
+    
+    //both layers are drawn again, at whatever scale the next paint() runs at
+    gridLayer.invalidate();
+    curveLayer.invalidate();
+    
+    analyzer.setBounds(getAnalysisArea().toFloat());
+    updateResponseCurve(false);
+    
+    //the image is the history: width x rows, reallocated only when the strip changes size
+    auto spectrogramArea = getSpectrogramArea();
+    
+    if( spectrogramArea.isEmpty() )
+    {
+        spectrogram = Image();
+    }
+    else if( spectrogram.getBounds() != spectrogramArea.withZeroOrigin() )
+    {
+        spectrogram = Image(Image::PixelFormat::RGB, spectrogramArea.getWidth(), spectrogramArea.getHeight(), true);
+        spectrogramNewestRow = 0;
+    }
+    
+    analyzer.setSpectrogram(spectrogramSeconds, spectrogram.isValid() ? spectrogram.getHeight() : 0);
+}
+
+juce::Rectangle<int> ResponseCurveComponent::getRenderArea()
+{
+    auto bounds = getLocalBounds();
+       
+    bounds.removeFromTop(12);
+    bounds.removeFromBottom(getSpectrogramHeight());
+    bounds.removeFromBottom(2);
+    bounds.removeFromLeft(20);
+    bounds.removeFromRight(20);
+    return bounds;
+}
+
+juce::Rectangle<int> ResponseCurveComponent::getAnalysisArea()
+{
+    auto bounds = getRenderArea();
+    bounds.removeFromTop(4);
+    bounds.removeFromBottom(4);
+    return bounds;
+}
+
+juce::Rectangle<int> ResponseCurveComponent::getSpectrogramArea()
+{
+    //same columns as the analysis area, so each frequency sits under its point on the curve
+    auto analysisArea = getAnalysisArea();
+    auto bounds = getLocalBounds().removeFromBottom(getSpectrogramHeight()).reduced(0, 2);
+    
+    return bounds.withX(analysisArea.getX()).withWidth(analysisArea.getWidth());
+}
+
+//==============================================================================
+PresetPanel::PresetPanel(JhanEQAudioProcessor& p) :
+audioProcessor(p),
+morphSliderAttachment(audioProcessor.apvts, "Preset Morph", morphSlider)
+{
+    searchBox.setTextToShowWhenEmpty("Search / preset name", juce::Colours::grey);
+    searchBox.onTextChange = [this] { updateSearch(); };
+    
+    presetList.setModel(this);
+    presetList.setColour(juce::ListBox::backgroundColourId, juce::Colours::black);
+    
+    saveButton.onClick = [this]
+    {
+        auto& library = audioProcessor.getPresetLibrary();
+        
+        auto name = searchBox.getText().trim();
+        if( name.isEmpty() )
+            name = "Preset " + juce::String(library.getNumPresets() + 1);
+        
+        library.addPreset(name, getChainSettings(audioProcessor.apvts));
+        audioProcessor.updateHostDisplay();
+        
+        updateSearch();
+    };
+    
+    setAButton.onClick = [this]
+    {
+        audioProcessor.setMorphPreset(false, getPresetIndex(presetList.getSelectedRow()));
+        updateMorphControls();
+    };
+    
+    setBButton.onClick = [this]
+    {
+        audioProcessor.setMorphPreset(true, getPresetIndex(presetList.getSelectedRow()));
+        updateMorphControls();
+    };
+    
+    clearMorphButton.onClick = [this]
+    {
+        audioProcessor.clearMorphPresets();
+        updateMorphControls();
+    };
+    
+    for( auto* comp : std::initializer_list<juce::Component*> { &searchBox, &presetList, &saveButton, &setAButton, &setBButton, &clearMorphButton, &morphSlider } )
+    {
+        addAndMakeVisible(comp);
+    }
+    
+    updateMorphControls();
+    
+    audioProcessor.apvts.state.addListener(this);
+}
+
+PresetPanel::~PresetPanel()
+{
+    audioProcessor.apvts.state.removeListener(this);
+    presetList.setModel(nullptr);
+}
+
+int PresetPanel::getNumRows()
+{
+    return isSearching ? searchResults.size() : audioProcessor.getPresetLibrary().getNumPresets();
+}
+
+void PresetPanel::paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    using namespace juce;
+    
+    if( rowIsSelected )
+        g.fillAll(Colour(0u, 97u, 100u));
+    
+    auto name = audioProcessor.getPresetLibrary().getName(getPresetIndex(rowNumber));
+    
+    //the morph keeps its own copies, so mark the rows whose names match
+    String prefix;
+    if( name == audioProcessor.getMorphPresetName(false) )
+        prefix << "[A] ";
+    if( name == audioProcessor.getMorphPresetName(true) )
+        prefix << "[B] ";
+    
+    g.setColour(Colours::white);
+    g.setFont(height * 0.7f);
+    g.drawText(prefix + name, 4, 0, width - 8, height, Justification::centredLeft, true);
+}
+
+void PresetPanel::selectedRowsChanged(int lastRowSelected)
+{
+    if( lastRowSelected >= 0 )
+        audioProcessor.loadPreset(getPresetIndex(lastRowSelected));
+}
+
+void PresetPanel::valueTreeChildAdded(juce::ValueTree& parent, juce::ValueTree& child)
+{
+    if( parent.hasType("Morph") || child.hasType("Morph") )
+        updateMorphControls();
+}
+
+void PresetPanel::valueTreeChildRemoved(juce::ValueTree& parent, juce::ValueTree& child, int index)
+{
+    if( parent.hasType("Morph") || child.hasType("Morph") )
+        updateMorphControls();
+}
+
+void PresetPanel::resized()
+{
+    auto bounds = getLocalBounds().reduced(4);
+    
+    searchBox.setBounds(bounds.removeFromTop(24));
+    bounds.removeFromTop(4);
+    
+    morphSlider.setBounds(bounds.removeFromBottom(24));
+    
+    auto buttonArea = bounds.removeFromBottom(24);
+    auto buttonWidth = buttonArea.getWidth() / 4;
+    saveButton.setBounds(buttonArea.removeFromLeft(buttonWidth));
+    setAButton.setBounds(buttonArea.removeFromLeft(buttonWidth));
+    setBButton.setBounds(buttonArea.removeFromLeft(buttonWidth));
+    clearMorphButton.setBounds(buttonArea);
+    
+    bounds.removeFromBottom(4);
+    presetList.setBounds(bounds);
+}
+
+int PresetPanel::getPresetIndex(int row) const
+{
+    if( row < 0 )
+        return -1;
+    
+    return isSearching ? searchResults[row] : row;
+}
+
+void PresetPanel::updateSearch()
+{
+    auto text = searchBox.getText().trim();
+    
+    isSearching = text.isNotEmpty();
+    searchResults = isSearching ? audioProcessor.getPresetLibrary().search(text) : juce::Array<int>();
+    
+    presetList.updateContent();
+    presetList.repaint();
+}
+
+void PresetPanel::updateMorphControls()
+{
+    auto morphing = audioProcessor.hasMorphPresets();
+    
+    morphSlider.setEnabled(morphing);
+    clearMorphButton.setEnabled(morphing);
+    
+    presetList.repaint();
+}
+
+//==============================================================================
+LevelMeterComponent::LevelMeterComponent(JhanEQAudioProcessor& p) :
+audioProcessor(p)
+{
+    peakDecibels.fill(minDecibels);
+    rmsDecibels.fill(minDecibels);
+    truePeakHold.fill(-100.f);
+    
+    audioProcessor.attachMeters();
+    startTimerHz(refreshRate);
+}
+
+LevelMeterComponent::~LevelMeterComponent()
+{
+    audioProcessor.detachMeters();
+}
+
+void LevelMeterComponent::timerCallback()
 {
-    auto chainSettings = getChainSettings(audioProcessor.apvts);
+    using namespace juce;
+    auto& levels = audioProcessor.getOutputLevels();
     
-    auto peakCoefficients = makePeakFilter(chainSettings, audioProcessor.getSampleRate());
-    updateCoefficients(monoChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
+    for( int c = 0; c < LevelMeterValues::maxChannels; ++c )
+    {
+        //the peaks come in as the highest since the last tick, the fall happens here
+        auto peak = Decibels::gainToDecibels(levels.takePeak(c), minDecibels);
+        peakDecibels[(size_t)c] = jmax(peak, peakDecibels[(size_t)c] - peakFallDecibelsPerSecond / refreshRate);
+        
+        rmsDecibels[(size_t)c] = Decibels::gainToDecibels(std::sqrt(levels.meanSquare[(size_t)c].load()), minDecibels);
+        truePeakHold[(size_t)c] = jmax(truePeakHold[(size_t)c], Decibels::gainToDecibels(levels.takeTruePeak(c), -100.f));
+    }
     
-    auto highPassCoefficients = makeHighPassFilter(chainSettings, audioProcessor.getSampleRate());
-    auto lowPassCoefficients = makeLowPassFilter(chainSettings, audioProcessor.getSampleRate());
-    updatePassFilter(monoChain.get<ChainPositions::HighPass>(), highPassCoefficients, chainSettings.highPassSlope);
-    updatePassFilter(monoChain.get<ChainPositions::LowPass>(), lowPassCoefficients, chainSettings.lowPassSlope);
+    momentaryLUFS = LevelMeterValues::toLUFS(levels.momentaryPower.load());
+    shortTermLUFS = LevelMeterValues::toLUFS(levels.shortTermPower.load());
     
+    repaint();
 }
 
-void ResponseCurveComponent::paint (juce::Graphics& g)
+void LevelMeterComponent::paint(juce::Graphics& g)
 {
-    
     using namespace juce;
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll (Colours::black);
+    g.fillAll(Colours::black);
     
-    g.drawImage(background, getLocalBounds().toFloat());
+    auto bounds = getLocalBounds().reduced(4);
+    g.setFont(10);
     
-//    auto responseArea = getLocalBounds();
-    auto responseArea = getAnalysisArea();//getRenderArea();
-    
-    auto w = responseArea.getWidth();
-    
-    auto& highPass = monoChain.get<ChainPositions::HighPass>();
-    auto& peak = monoChain.get<ChainPositions::Peak>();
-    auto& lowPass = monoChain.get<ChainPositions::LowPass>();
-    
-    auto sampleRate = audioProcessor.getSampleRate();
-    
-    std::vector<double> mags;
-    
-    mags.resize(w);
+    auto toX = [](float decibels, Rectangle<float> bar)
+    {
+        return jmap(jlimit(minDecibels, 0.f, decibels), minDecibels, 0.f, bar.getX(), bar.getRight());
+    };
     
-    for ( int i = 0; i < w; ++i) {
-        
-        double mag = 1.f;
-        auto freq = mapToLog10(double(i) / double(w), 20.0, 20000.);
+    for( int c = 0; c < LevelMeterValues::maxChannels; ++c )
+    {
+        auto row = bounds.removeFromTop(12);
+        g.setColour(Colours::lightgrey);
+        g.drawText(c == 0 ? "L" : "R", row.removeFromLeft(12), Justification::centred);
         
-        if(! monoChain.isBypassed<ChainPositions::Peak>() )
-            mag *= peak.coefficients->getMagnitudeForFrequency(freq, sampleRate);
+        auto bar = row.reduced(0, 2).toFloat();
+        g.setColour(Colours::darkgrey);
+        g.fillRect(bar);
         
-        if( !highPass.isBypassed<0>() )
-            mag *= highPass.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if( !highPass.isBypassed<1>() )
-                   mag *= highPass.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if( !highPass.isBypassed<2>() )
-                   mag *= highPass.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if( !highPass.isBypassed<3>() )
-                   mag *= highPass.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+        g.setColour(Colour(137u, 203u, 178u));
+        g.fillRect(bar.withRight(toX(rmsDecibels[(size_t)c], bar)));
         
-        if( !lowPass.isBypassed<0>() )
-            mag *= lowPass.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if( !lowPass.isBypassed<1>() )
-                   mag *= lowPass.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if( !lowPass.isBypassed<2>() )
-                   mag *= lowPass.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if( !lowPass.isBypassed<3>() )
-                   mag *= lowPass.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            
-        mags[i] = Decibels::gainToDecibels(mag);
+        auto peak = peakDecibels[(size_t)c];
+        g.setColour(peak >= 0.f ? Colours::red : Colours::white);
+        g.fillRect(Rectangle<float>(toX(peak, bar) - 1.f, bar.getY(), 2.f, bar.getHeight()));
         
+        bounds.removeFromTop(2);
     }
     
-    // responseCurve
-    
-    Path responseCurve;
-    
-    const double outputMin = responseArea.getBottom();
-    const double outputMax = responseArea.getY();
-    auto map = [outputMin, outputMax](double input)
+    auto format = [](float decibels)
     {
-        return jmap(input, -24.0, 24.0, outputMin, outputMax);
+        return decibels <= -99.f ? String("-inf") : String(decibels, 1);
     };
     
-    responseCurve.startNewSubPath(responseArea.getX(), map(mags.front()));
+    auto truePeak = jmax(truePeakHold[0], truePeakHold[1]);
+    g.setColour(truePeak >= 0.f ? Colours::red : truePeak >= -1.f ? Colours::orange : Colours::lightgrey);
+    g.drawText("TP " + format(truePeakHold[0]) + " / " + format(truePeakHold[1]) + " dBTP",
+               bounds.removeFromTop(14), Justification::centredLeft);
+    
+    g.setColour(Colours::lightgrey);
+    g.drawText("M " + format(momentaryLUFS) + "   S " + format(shortTermLUFS) + " LUFS",
+               bounds.removeFromTop(14), Justification::centredLeft);
+}
+
+void LevelMeterComponent::mouseDown(const juce::MouseEvent&)
+{
+    truePeakHold.fill(-100.f);
+}
+
+//==============================================================================
+GoniometerComponent::GoniometerComponent(JhanEQAudioProcessor& p) :
+audioProcessor(p),
+points((size_t)(2 * maxPointsPerFrame))
+{
+    //the correlation comes with the meters
+    audioProcessor.attachMeters();
+    audioProcessor.attachGoniometer();
+    startTimerHz(refreshRate);
+}
+
+GoniometerComponent::~GoniometerComponent()
+{
+    audioProcessor.detachGoniometer();
+    audioProcessor.detachMeters();
+}
+
+void GoniometerComponent::timerCallback()
+{
+    auto numPoints = audioProcessor.getGoniometerFeed().readPoints(points.data(), maxPointsPerFrame);
     
-    for( size_t i = 1; i < mags.size(); ++i)
+    if( trace.isValid() )
     {
-        responseCurve.lineTo(responseArea.getX() + i, map(mags[i]));
+        fadeTrace();
+        plotPoints(numPoints);
     }
     
-    //set to image
-    
-    g.setColour(Colours::orange);
-    g.drawRoundedRectangle(getRenderArea().toFloat(), 4.f, 1.f);
-    
-    g.setColour(Colours::white);
-    g.strokePath(responseCurve, PathStrokeType(2.f));
+    //a little smoothing so the value can be read rather than just watched
+    correlation += 0.3f * (audioProcessor.getOutputLevels().correlation.load() - correlation);
     
+    repaint();
 }
 
-void ResponseCurveComponent::resized()
+void GoniometerComponent::fadeTrace()
 {
     using namespace juce;
-    background = Image(Image::PixelFormat::RGB, getWidth(), getHeight(), true);
-    
-    Graphics g(background);
     
-    Array<float> freqs
-    {
-        20, /*30, 40,*/ 50, 100,
-        200, /*300, 400,*/ 500, 1000,
-        2000, /*3000, 4000,*/ 5000, 10000,
-        20000
-    };
+    //per tick, so the persistence doesn't depend on the refresh rate
+    const auto fade = (int)std::lround(256.0 * std::pow(0.5, 1.0 / (refreshRate * persistenceSeconds)));
     
-    auto renderArea = getAnalysisArea();
-    auto left = renderArea.getX();
-    auto right = renderArea.getRight();
-    auto top = renderArea.getY();
-    auto bottom = renderArea.getBottom();
-    auto width = renderArea.getWidth();
+    Image::BitmapData data(trace, Image::BitmapData::readWrite);
     
-    Array<float> xs;
-    for( auto f : freqs )
+    for( int y = 0; y < data.height; ++y )
     {
-        auto normX = mapFromLog10(f, 20.f, 20000.f);
-        xs.add(left + width * normX);
+        auto* pixel = data.getLinePointer(y);
+        
+        for( int x = 0; x < data.width; ++x, pixel += data.pixelStride )
+            *pixel = (uint8)((*pixel * fade) >> 8);
     }
-    
-    g.setColour(Colours::dimgrey);
+}
 
-    for( auto x : xs)
-    {
-        g.drawVerticalLine(x, top, bottom);
-    }
-    
-    Array<float> gain
-    {
-        -24, -12, 0, 12, 24
-    };
+void GoniometerComponent::plotPoints(int numPoints)
+{
+    using namespace juce;
     
-    for( auto gDb : gain)
-    {
-        auto y = jmap(gDb, -24.f,  24.f, float(bottom), float(top));
-        g.setColour(gDb == 0.f ? Colour(137u, 203u, 178u) : Colours::darkgrey );
-        g.drawHorizontalLine(y, left, right);
-        
-    }
+    Image::BitmapData data(trace, Image::BitmapData::readWrite);
     
-//    g.drawRect(getAnalysisArea());
+    const auto centreX = data.width * 0.5f;
+    const auto centreY = data.height * 0.5f;
     
-    g.setColour(Colours::lightgrey);
-    const int fontHeight = 10;
-    g.setFont(fontHeight);
+    //the diamond of full scale L and R touches the edges of the plot
+    const auto scale = jmin(centreX, centreY) * 0.5f;
     
-    for( int i = 0; i < freqs.size(); ++i)
+    for( int i = 0; i < numPoints; ++i )
     {
-        auto f = freqs[i];
-        auto x = xs[i];
+        const auto left = points[(size_t)(2 * i)];
+        const auto right = points[(size_t)(2 * i + 1)];
         
-        bool addK = false;
-        String str;
-        if( f > 999.f)
+        const auto x = roundToInt(centreX + (right - left) * scale);
+        const auto y = roundToInt(centreY - (left + right) * scale);
+        
+        if( isPositiveAndBelow(x, data.width) && isPositiveAndBelow(y, data.height) )
         {
-            addK = true;
-            f /= 1000.f;
+            auto* pixel = data.getPixelPointer(x, y);
+            *pixel = (uint8)jmin(255, *pixel + 96);
         }
-        
-        str << f;
-        if ( addK )
-            str << "k";
-        str << "Hz";
-        
-        auto textWidth = g.getCurrentFont().getStringWidth(str);
-        
-        Rectangle<int> r;
-        r.setSize(textWidth, fontHeight);
-        r.setCentre(x, 0);
-        r.setY(1);
-    
-        g.drawFittedText(str, r, juce::Justification::centred, 1);
     }
+}
+
+void GoniometerComponent::paint(juce::Graphics& g)
+{
+    using namespace juce;
+    g.fillAll(Colours::black);
     
-    //gain dB Text
-    for( auto gDb : gain)
+    auto plot = getPlotArea().toFloat();
+    auto centre = plot.getCentre();
+    auto radius = plot.getWidth() * 0.5f;
+    
+    //full scale, the mid and side axes, and the L and R axes on the diagonals
+    g.setColour(Colours::darkgrey);
+    
+    Path diamond;
+    diamond.startNewSubPath(centre.x, plot.getY());
+    diamond.lineTo(plot.getRight(), centre.y);
+    diamond.lineTo(centre.x, plot.getBottom());
+    diamond.lineTo(plot.getX(), centre.y);
+    diamond.closeSubPath();
+    g.strokePath(diamond, PathStrokeType(1.f));
+    
+    g.drawLine(centre.x, plot.getY(), centre.x, plot.getBottom());
+    g.drawLine(plot.getX(), centre.y, plot.getRight(), centre.y);
+    g.drawLine(centre.x - radius * 0.5f, centre.y - radius * 0.5f, centre.x + radius * 0.5f, centre.y + radius * 0.5f);
+    g.drawLine(centre.x + radius * 0.5f, centre.y - radius * 0.5f, centre.x - radius * 0.5f, centre.y + radius * 0.5f);
+    
+    g.setFont(10);
+    g.setColour(Colours::lightgrey);
+    g.drawText("L", Rectangle<float>(12, 12).withCentre({ centre.x - radius * 0.5f - 6.f, centre.y - radius * 0.5f - 6.f }), Justification::centred);
+    g.drawText("R", Rectangle<float>(12, 12).withCentre({ centre.x + radius * 0.5f + 6.f, centre.y - radius * 0.5f - 6.f }), Justification::centred);
+    
+    if( trace.isValid() )
     {
-        auto y = jmap(gDb, -24.f,  24.f, float(bottom), float(top));
-        
-        String str;
-        if (gDb > 0)
-            str << "+";
-        str << gDb;
-        
-        auto textWidth = g.getCurrentFont().getStringWidth(str);
-        
-        Rectangle<int> r;
-        r.setSize(textWidth, fontHeight);
-        r.setX(getWidth() - textWidth);
-        r.setCentre(r.getCentreX(), y);
-        
-        g.setColour(gDb == 0.f ? Colour(137u, 203u, 178u) : Colours::lightgrey );
-        
-        g.drawFittedText(str, r, juce::Justification::centred, 1);
-        
-        
-        //slope Text
-        str.clear();
-        str << (gDb - 24.f);
-        
-        r.setX(1);
-        textWidth = g.getCurrentFont().getStringWidth(str);
-        r.setSize(textWidth, fontHeight);
-        g.setColour(Colours::lightgrey);
-        g.drawFittedText(str, r, juce::Justification::centred, 1);
+        g.setColour(Colour(137u, 203u, 178u));
+        g.drawImageAt(trace, (int)plot.getX(), (int)plot.getY(), true);
     }
+    
+    //-1 to +1, filled from the centre
+    auto area = getCorrelationArea();
+    auto label = area.removeFromRight(32);
+    auto bar = area.reduced(0, 2).toFloat();
+    
+    g.setColour(Colours::darkgrey);
+    g.fillRect(bar);
+    
+    auto zero = bar.getCentreX();
+    auto value = jmap(jlimit(-1.f, 1.f, correlation), -1.f, 1.f, bar.getX(), bar.getRight());
+    
+    g.setColour(correlation < 0.f ? Colours::red : Colour(137u, 203u, 178u));
+    g.fillRect(Rectangle<float>(jmin(zero, value), bar.getY(), std::abs(value - zero), bar.getHeight()));
+    
+    g.setColour(Colours::white);
+    g.fillRect(Rectangle<float>(zero - 0.5f, bar.getY(), 1.f, bar.getHeight()));
+    
+    g.setColour(Colours::lightgrey);
+    g.drawText(String(correlation, 2), label, Justification::centredRight);
 }
 
-juce::Rectangle<int> ResponseCurveComponent::getRenderArea()
+void GoniometerComponent::resized()
 {
-    auto bounds = getLocalBounds();
-       
-    bounds.removeFromTop(12);
-    bounds.removeFromBottom(2);
-    bounds.removeFromLeft(20);
-    bounds.removeFromRight(20);
-    return bounds;
+    //a new image only when the plot changes size, the trace starts over then
+    auto plot = getPlotArea();
+    
+    if( plot.isEmpty() )
+        trace = juce::Image();
+    else if( trace.getBounds() != plot.withZeroOrigin() )
+        trace = juce::Image(juce::Image::SingleChannel, plot.getWidth(), plot.getHeight(), true, juce::SoftwareImageType());
 }
 
-juce::Rectangle<int> ResponseCurveComponent::getAnalysisArea()
+juce::Rectangle<int> GoniometerComponent::getPlotArea() const
 {
-    auto bounds = getRenderArea();
-    bounds.removeFromTop(4);
-    bounds.removeFromBottom(4);
-    return bounds;
+    auto bounds = getLocalBounds().reduced(4);
+    bounds.removeFromBottom(16);
+    
+    //square, and a little in from the edges for the labels
+    auto size = juce::jmax(0, juce::jmin(bounds.getWidth(), bounds.getHeight()) - 8);
+    return juce::Rectangle<int>(size, size).withCentre(bounds.getCentre());
+}
+
+juce::Rectangle<int> GoniometerComponent::getCorrelationArea() const
+{
+    return getLocalBounds().reduced(4).removeFromBottom(12);
 }
 
 //==============================================================================
@@ -520,13 +1795,22 @@ highPassSlopeSlider(*audioProcessor.apvts.getParameter("HighPass Slope"), "dB/Oc
 lowPassSlopeSlider(*audioProcessor.apvts.getParameter("LowPass Slope"), "dB/Oct"),
 
 responseCurveComponent(audioProcessor),
+autoGainButton("Auto Gain"),
+analyzerPreEQButton("Pre EQ"),
+phaseButton("Phase"),
+groupDelayButton("Delay"),
+measureButton("Measure Response"),
+presetPanel(audioProcessor),
+levelMeter(audioProcessor),
+goniometer(audioProcessor),
 peakFreqSliderAttachment(audioProcessor.apvts, "Peak Freq", peakFreqSlider),
 peakGainSliderAttachment(audioProcessor.apvts, "Peak Gain", peakGainSlider),
 peakQualitySliderAttachment(audioProcessor.apvts, "Peak Quality", peakQualitySlider),
 highPassFreqSliderAttachment(audioProcessor.apvts, "HighPass Freq", highPassFreqSlider),
 lowPassFreqSliderAttachment(audioProcessor.apvts, "LowPass Freq", lowPassFreqSlider),
 highPassSlopeSliderAttachment(audioProcessor.apvts, "HighPass Slope", highPassSlopeSlider),
-lowPassSlopeSliderAttachment(audioProcessor.apvts, "LowPass Slope", lowPassSlopeSlider)
+lowPassSlopeSliderAttachment(audioProcessor.apvts, "LowPass Slope", lowPassSlopeSlider),
+autoGainButtonAttachment(audioProcessor.apvts, "Auto Gain", autoGainButton)
 
 {
     // Make sure that before the constructor has finished, you've set the
@@ -557,8 +1841,186 @@ lowPassSlopeSliderAttachment(audioProcessor.apvts, "LowPass Slope", lowPassSlope
     {
         addAndMakeVisible(comp);
     }
+    
+    captureReferenceButton.setClickingTogglesState(true);
+    captureInputButton.setClickingTogglesState(true);
+    matchButton.setEnabled(false);
+    
+    captureReferenceButton.onClick = [this]
+    {
+        setMatchCapture(captureReferenceButton.getToggleState() ? MatchEQ::Capture::Reference : MatchEQ::Capture::None);
+    };
+    
+    captureInputButton.onClick = [this]
+    {
+        setMatchCapture(captureInputButton.getToggleState() ? MatchEQ::Capture::Input : MatchEQ::Capture::None);
+    };
+    
+    autoGainReferenceBox.addItemList(audioProcessor.apvts.getParameter("Auto Gain Reference")->getAllValueStrings(), 1);
+    autoGainReferenceAttachment = std::make_unique<ComboBoxAttachment>(audioProcessor.apvts, "Auto Gain Reference", autoGainReferenceBox);
+    
+    //item ids are the FFT order and the zero padding factor, so they go straight into the state
+    analyzerResolutionBox.addItem("2048", FFTOrder::order2048);
+    analyzerResolutionBox.addItem("4096", FFTOrder::order4096);
+    analyzerResolutionBox.addItem("8192", FFTOrder::order8192);
+    analyzerResolutionBox.addItem("Multi-Res", multiResolutionId);
+    
+    analyzerZeroPadBox.addItem("No Padding", 1);
+    analyzerZeroPadBox.addItem("Pad 2x", 2);
+    analyzerZeroPadBox.addItem("Pad 4x", 4);
+    
+    auto analyzerState = audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr);
+    analyzerResolutionBox.setSelectedId(analyzerState.getProperty("Order", (int)FFTOrder::order2048), juce::dontSendNotification);
+    analyzerZeroPadBox.setSelectedId(analyzerState.getProperty("ZeroPad", 1), juce::dontSendNotification);
+    
+    if( analyzerResolutionBox.getSelectedId() == 0 )
+        analyzerResolutionBox.setSelectedId(FFTOrder::order2048, juce::dontSendNotification);
+    
+    if( analyzerZeroPadBox.getSelectedId() == 0 )
+        analyzerZeroPadBox.setSelectedId(1, juce::dontSendNotification);
+    
+    analyzerResolutionBox.onChange = [this] { updateAnalyzerResolution(); };
+    analyzerZeroPadBox.onChange = [this] { updateAnalyzerResolution(); };
+    updateAnalyzerResolution();
+    
+    //ids are the SpectrumKernel::Mode plus one
+    analyzerModeBox.addItem("Instant", 1 + (int)SpectrumKernel::Mode::Instant);
+    analyzerModeBox.addItem("Average", 1 + (int)SpectrumKernel::Mode::Average);
+    analyzerModeBox.addItem("Peak Hold", 1 + (int)SpectrumKernel::Mode::PeakHold);
+    analyzerModeBox.setSelectedId(juce::jlimit(1, 3, (int)analyzerState.getProperty("Mode", 1)), juce::dontSendNotification);
+    
+    analyzerModeBox.onChange = [this]
+    {
+        auto id = analyzerModeBox.getSelectedId();
+        audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr).setProperty("Mode", id, nullptr);
+        responseCurveComponent.setAnalyzerMode(static_cast<SpectrumKernel::Mode>(id - 1));
+    };
+    analyzerModeBox.onChange();
+    
+    //ids are the octave fraction, except 1 for none
+    analyzerSmoothingBox.addItem("No Smoothing", 1);
+    analyzerSmoothingBox.addItem("1/3 Oct", 3);
+    analyzerSmoothingBox.addItem("1/6 Oct", 6);
+    analyzerSmoothingBox.addItem("1/12 Oct", 12);
+    analyzerSmoothingBox.setSelectedId(analyzerState.getProperty("Smoothing", 1), juce::dontSendNotification);
+    
+    if( analyzerSmoothingBox.getSelectedId() == 0 )
+        analyzerSmoothingBox.setSelectedId(1, juce::dontSendNotification);
+    
+    analyzerSmoothingBox.onChange = [this]
+    {
+        auto id = analyzerSmoothingBox.getSelectedId();
+        audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr).setProperty("Smoothing", id, nullptr);
+        responseCurveComponent.setAnalyzerSmoothing(id == 1 ? 0 : id);
+    };
+    analyzerSmoothingBox.onChange();
+    
+    analyzerChannelsBox.addItem("Left", 1 + (int)SpectrumAnalyzer::ChannelView::Left);
+    analyzerChannelsBox.addItem("L / R", 1 + (int)SpectrumAnalyzer::ChannelView::Stereo);
+    analyzerChannelsBox.addItem("M / S", 1 + (int)SpectrumAnalyzer::ChannelView::MidSide);
+    analyzerChannelsBox.setSelectedId(juce::jlimit(1, 3, (int)analyzerState.getProperty("Channels", 1)), juce::dontSendNotification);
+    analyzerPreEQButton.setToggleState(analyzerState.getProperty("PreEQ", false), juce::dontSendNotification);
+    
+    auto updateAnalyzerView = [this]
+    {
+        auto id = analyzerChannelsBox.getSelectedId();
+        auto showPreEQ = analyzerPreEQButton.getToggleState();
+        
+        auto state = audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr);
+        state.setProperty("Channels", id, nullptr);
+        state.setProperty("PreEQ", showPreEQ, nullptr);
+        
+        responseCurveComponent.setAnalyzerView(static_cast<SpectrumAnalyzer::ChannelView>(id - 1), showPreEQ);
+    };
+    
+    analyzerChannelsBox.onChange = updateAnalyzerView;
+    analyzerPreEQButton.onClick = updateAnalyzerView;
+    updateAnalyzerView();
+    
+    //ids are the history in seconds, 1 = off
+    spectrogramBox.addItem("No Spectrogram", 1);
+    spectrogramBox.addItem("2 s", 2);
+    spectrogramBox.addItem("5 s", 5);
+    spectrogramBox.addItem("10 s", 10);
+    spectrogramBox.addItem("30 s", 30);
+    spectrogramBox.setSelectedId(analyzerState.getProperty("Spectrogram", 1), juce::dontSendNotification);
+    
+    if( spectrogramBox.getSelectedId() == 0 )
+        spectrogramBox.setSelectedId(1, juce::dontSendNotification);
+    
+    spectrogramBox.onChange = [this]
+    {
+        auto id = spectrogramBox.getSelectedId();
+        audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr).setProperty("Spectrogram", id, nullptr);
+        responseCurveComponent.setSpectrogramHistory(id == 1 ? 0.0 : (double)id);
+        
+        //the curve grows or shrinks by the spectrogram strip
+        resized();
+    };
+    spectrogramBox.onChange();
+    
+    //ids are the frame rate
+    for( auto framesPerSecond : { 15, 30, 60, 120 } )
+        frameRateBox.addItem(juce::String(framesPerSecond) + " fps max", framesPerSecond);
+    
+    frameRateBox.setSelectedId(analyzerState.getProperty("MaxFrameRate", 60), juce::dontSendNotification);
+    
+    if( frameRateBox.getSelectedId() == 0 )
+        frameRateBox.setSelectedId(60, juce::dontSendNotification);
+    
+    frameRateBox.onChange = [this]
+    {
+        auto id = frameRateBox.getSelectedId();
+        audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr).setProperty("MaxFrameRate", id, nullptr);
+        responseCurveComponent.setMaxFrameRate(id);
+    };
+    frameRateBox.onChange();
+    
+    phaseButton.setToggleState(analyzerState.getProperty("ShowPhase", false), juce::dontSendNotification);
+    groupDelayButton.setToggleState(analyzerState.getProperty("ShowGroupDelay", false), juce::dontSendNotification);
+    
+    auto updateResponseCurves = [this]
+    {
+        auto state = audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr);
+        state.setProperty("ShowPhase", phaseButton.getToggleState(), nullptr);
+        state.setProperty("ShowGroupDelay", groupDelayButton.getToggleState(), nullptr);
+        
+        responseCurveComponent.setResponseCurves((phaseButton.getToggleState() ? ResponseKernel::Phase : 0)
+                                                 | (groupDelayButton.getToggleState() ? ResponseKernel::GroupDelay : 0));
+    };
+    
+    phaseButton.onClick = updateResponseCurves;
+    groupDelayButton.onClick = updateResponseCurves;
+    updateResponseCurves();
+    
+    measureButton.setToggleState(analyzerState.getProperty("MeasureResponse", false), juce::dontSendNotification);
+    
+    measureButton.onClick = [this]
+    {
+        auto measure = measureButton.getToggleState();
+        audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr).setProperty("MeasureResponse", measure, nullptr);
+        responseCurveComponent.setTransferMeasurement(measure);
+    };
+    measureButton.onClick();
+    
+    auto& matchEQ = responseCurveComponent.getMatchEQ();
+    
+    matchButton.onClick = [this, &matchEQ]
+    {
+        setMatchCapture(MatchEQ::Capture::None);
+        matchEQ.startFit(audioProcessor.apvts, audioProcessor.getSampleRate());
+        matchButton.setEnabled(false);
+    };
+    
+    matchEQ.onFitComplete = [this](const ChainSettings& fitted)
+    {
+        setChainSettings(audioProcessor.apvts, fitted);
+        setMatchCapture(MatchEQ::Capture::None);
+    };
 
-    setSize (600, 480);
+    setSize (800, 480);
+    
+    constructionDurationMs = juce::Time::getMillisecondCounterHiRes() - openStartMs;
 }
 
 JhanEQAudioProcessorEditor::~JhanEQAudioProcessorEditor()
@@ -577,13 +2039,66 @@ void JhanEQAudioProcessorEditor::paint (juce::Graphics& g)
     
 }
 
+void JhanEQAudioProcessorEditor::paintOverChildren (juce::Graphics&)
+{
+    //the children have all painted once by now
+    if( openDurationMs == 0 )
+    {
+        openDurationMs = juce::Time::getMillisecondCounterHiRes() - openStartMs;
+        
+        //only where a host or the benchmarks asked for it, never to the debug output by default
+        if( auto* logger = juce::Logger::getCurrentLogger() )
+            logger->logMessage("Editor opened in " + juce::String(openDurationMs) + "ms ("
+                               + juce::String(constructionDurationMs) + "ms constructing)");
+    }
+}
+
 void JhanEQAudioProcessorEditor::resized()
 {
     // This is generally where you'll want to lay out the positions of any
     // subcomponents in your editor..
     auto bounds = getLocalBounds();
+    
+    auto sideArea = bounds.removeFromRight(200);
+    levelMeter.setBounds(sideArea.removeFromBottom(64));
+    goniometer.setBounds(sideArea.removeFromBottom(180));
+    measureButton.setBounds(sideArea.removeFromBottom(24).reduced(4, 2));
+    
+    auto displayArea = sideArea.removeFromBottom(24).reduced(4, 2);
+    frameRateBox.setBounds(displayArea.removeFromLeft(84));
+    displayArea.removeFromLeft(4);
+    phaseButton.setBounds(displayArea.removeFromLeft(displayArea.getWidth() / 2));
+    groupDelayButton.setBounds(displayArea);
+    presetPanel.setBounds(sideArea);
+    
+    auto analyzerArea = bounds.removeFromBottom(24).reduced(4, 2);
+    analyzerResolutionBox.setBounds(analyzerArea.removeFromLeft(84));
+    analyzerArea.removeFromLeft(4);
+    analyzerZeroPadBox.setBounds(analyzerArea.removeFromLeft(92));
+    analyzerArea.removeFromLeft(4);
+    analyzerModeBox.setBounds(analyzerArea.removeFromLeft(84));
+    analyzerArea.removeFromLeft(4);
+    analyzerSmoothingBox.setBounds(analyzerArea.removeFromLeft(96));
+    analyzerArea.removeFromLeft(4);
+    analyzerChannelsBox.setBounds(analyzerArea.removeFromLeft(64));
+    analyzerArea.removeFromLeft(4);
+    analyzerPreEQButton.setBounds(analyzerArea.removeFromLeft(64));
+    analyzerArea.removeFromLeft(4);
+    spectrogramBox.setBounds(analyzerArea);
+    
+    auto matchArea = bounds.removeFromBottom(24).reduced(4, 2);
+    
+    auto autoGainArea = matchArea.removeFromRight(matchArea.getWidth() * 0.33);
+    autoGainButton.setBounds(autoGainArea.removeFromLeft(autoGainArea.getWidth() / 2));
+    autoGainReferenceBox.setBounds(autoGainArea);
+    
+    auto matchWidth = matchArea.getWidth() / 3;
+    captureReferenceButton.setBounds(matchArea.removeFromLeft(matchWidth));
+    captureInputButton.setBounds(matchArea.removeFromLeft(matchWidth));
+    matchButton.setBounds(matchArea);
+    
     float hRatio = 25.f / 100.f;
-    auto responseArea = bounds.removeFromTop(bounds.getHeight() * hRatio);
+    auto responseArea = bounds.removeFromTop(bounds.getHeight() * hRatio + responseCurveComponent.getSpectrogramHeight());
     
     responseCurveComponent.setBounds(responseArea);
     
@@ -616,7 +2131,54 @@ std::vector<juce::Component*> JhanEQAudioProcessorEditor::getComps()
         &lowPassFreqSlider,
         &highPassSlopeSlider,
         &lowPassSlopeSlider,
-        &responseCurveComponent
-        
+        &responseCurveComponent,
+        &captureReferenceButton,
+        &captureInputButton,
+        &matchButton,
+        &autoGainButton,
+        &autoGainReferenceBox,
+        &analyzerResolutionBox,
+        &analyzerZeroPadBox,
+        &analyzerModeBox,
+        &analyzerSmoothingBox,
+        &analyzerChannelsBox,
+        &analyzerPreEQButton,
+        &spectrogramBox,
+        &frameRateBox,
+        &phaseButton,
+        &groupDelayButton,
+        &measureButton,
+        &presetPanel,
+        &levelMeter,
+        &goniometer
     };
 }
+
+void JhanEQAudioProcessorEditor::setMatchCapture(MatchEQ::Capture capture)
+{
+    auto& matchEQ = responseCurveComponent.getMatchEQ();
+    responseCurveComponent.setMatchCapture(capture);
+    
+    captureReferenceButton.setToggleState(capture == MatchEQ::Capture::Reference, juce::dontSendNotification);
+    captureInputButton.setToggleState(capture == MatchEQ::Capture::Input, juce::dontSendNotification);
+    
+    //the averages only grow while capturing, so the button can be refreshed from here
+    matchButton.setEnabled(capture == MatchEQ::Capture::None && matchEQ.canFit());
+}
+
+void JhanEQAudioProcessorEditor::updateAnalyzerResolution()
+{
+    auto id = analyzerResolutionBox.getSelectedId();
+    auto zeroPadFactor = analyzerZeroPadBox.getSelectedId();
+    
+    auto analyzerState = audioProcessor.apvts.state.getOrCreateChildWithName("Analyzer", nullptr);
+    analyzerState.setProperty("Order", id, nullptr);
+    analyzerState.setProperty("ZeroPad", zeroPadFactor, nullptr);
+    
+    //multi resolution keeps the main FFT short, the low band brings the bass resolution
+    const auto multiResolution = id == multiResolutionId;
+    const auto order = multiResolution ? FFTOrder::order2048 : static_cast<FFTOrder>(id);
+    
+    responseCurveComponent.setAnalyzerResolution(order, zeroPadFactor);
+    responseCurveComponent.setAnalyzerMultiResolution(multiResolution);
+}
@@ -10,6 +10,12 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "MatchEQ.h"
+#include "AnalyzerThread.h"
+#include "SpectrumKernel.h"
+#include "Decimator.h"
+#include "ResponseKernel.h"
+#include "TransferFunction.h"
 
 enum FFTOrder
 {
@@ -18,104 +24,494 @@ enum FFTOrder
     order8192 = 13
 };
 
+/*
+ one analyzed frame. the storage is sized for the largest FFT up front, fftSize says
+ how much of it this frame uses, so frames of different sizes can share a Fifo.
+ up to maxTraces spectra ride along together, trace t's bins start at t * fftSize / 2.
+ */
+struct FFTFrame
+{
+    static constexpr int maxTraces = 4;
+    
+    std::vector<float> bins;
+    int fftSize = 0;
+    int traces = 0; //bit t set if trace t is in this frame
+    SampleRing::Position windowEnd = 0; //one past the window's last sample
+    
+    const float* getTrace(int trace) const { return bins.data() + trace * (fftSize / 2); }
+};
+
+/*
+ every FFT plan and window the analyzer can switch to, built once and shared by all
+ instances so that changing resolution never allocates.
+ */
+struct FFTPlans
+{
+    static constexpr int maxZeroPadOrder = 2; //up to 4x
+    static constexpr int maxOrder = FFTOrder::order8192 + maxZeroPadOrder;
+    
+    FFTPlans()
+    {
+        for( int order = FFTOrder::order2048; order <= maxOrder; ++order )
+            ffts.push_back(std::make_unique<juce::dsp::FFT>(order));
+        
+        for( int order = FFTOrder::order2048; order <= FFTOrder::order8192; ++order )
+        {
+            auto& window = windows[(size_t)(order - FFTOrder::order2048)];
+            window.resize((size_t)1 << order);
+            juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), window.size(),
+                                                                     juce::dsp::WindowingFunction<float>::blackmanHarris);
+        }
+    }
+    
+    const juce::dsp::FFT& getFFT(int order) const { return *ffts[(size_t)(order - FFTOrder::order2048)]; }
+    const std::vector<float>& getWindow(FFTOrder order) const { return windows[(size_t)(order - FFTOrder::order2048)]; }
+    
+    static constexpr int getMaxFFTSize() { return 1 << maxOrder; }
+private:
+    std::vector<std::unique_ptr<juce::dsp::FFT>> ffts;
+    std::array<std::vector<float>, 3> windows;
+};
+
 template<typename BlockType>
 struct FFTDataGenerator
 {
+    /*
+     where a trace's signal comes from: gainA * a + gainB * b, with b optional.
+     a trace without an 'a' is off.
+     */
+    struct TraceSource
+    {
+        const SampleRing* a = nullptr;
+        const SampleRing* b = nullptr;
+        float gainA = 1.f, gainB = 0.f;
+    };
+    
+    using TraceSources = std::array<TraceSource, FFTFrame::maxTraces>;
+    
+    /*
+     allocates for the largest size we switch to and picks up the shared plans. nothing
+     else needs it, but produceFFTDataForRendering can't run before it. not real time safe.
+     */
+    void prepare(const FFTPlans& sharedPlans)
+    {
+        plans = &sharedPlans;
+        
+        //every frame, in or out of the fifo, can hold the largest size we switch to
+        fftData.bins.resize((size_t)FFTPlans::getMaxFFTSize() * 2, 0.f);
+        fftDataFifo.prepare(fftData);
+        
+        for( auto& kernel : kernels )
+            kernel.prepare(FFTPlans::getMaxFFTSize() / 2);
+        
+        const auto maxWindowSize = (size_t)1 << FFTOrder::order8192;
+        windowed.resize(maxWindowSize);
+        windowedB.resize(maxWindowSize);
+        mixScratch.resize(maxWindowSize);
+        fftInput.resize((size_t)FFTPlans::getMaxFFTSize());
+        fftOutput.resize((size_t)FFTPlans::getMaxFFTSize());
+    }
+    
+    bool isPrepared() const { return plans != nullptr; }
+    
+    /*
+     only while produceFFTDataForRendering can't be running.
+     */
+    void setTraces(const TraceSources& newSources)
+    {
+        for( size_t t = 0; t < sources.size(); ++t )
+        {
+            if( newSources[t].a != sources[t].a || newSources[t].b != sources[t].b )
+                kernels[t].reset();
+        }
+        
+        sources = newSources;
+    }
+    
     /**
-     produces the FFT data from an audio buffer.
+     produces the FFT data for every trace from the windows starting at 'windowStart'.
+     returns false if the audio thread overwrote any of them while we read it.
      */
-    void produceFFTDataForRendering(const juce::AudioBuffer<float>& audioData, const float negativeInfinity)
+    bool produceFFTDataForRendering(SampleRing::Position windowStart, double sampleRate, const float negativeInfinity)
     {
+        const auto windowSize = getWindowSize();
         const auto fftSize = getFFTSize();
+        const int numBins = (int)fftSize / 2;
+        auto& bins = fftData.bins;
+        
+        //only happens if someone pulled into a frame of the wrong size
+        if( bins.size() < (size_t)fftSize * 2 )
+            bins.resize((size_t)FFTPlans::getMaxFFTSize() * 2);
+        
+        std::array<int, FFTFrame::maxTraces> active;
+        int numActive = 0;
         
-        fftData.assign(fftData.size(), 0);
-        auto* readIndex = audioData.getReadPointer(0);
-        std::copy(readIndex, readIndex + fftSize, fftData.begin());
+        for( int t = 0; t < FFTFrame::maxTraces; ++t )
+            if( sources[(size_t)t].a != nullptr )
+                active[(size_t)numActive++] = t;
         
-        // first apply a windowing function to our data
-        window->multiplyWithWindowingTable (fftData.data(), fftSize);       // [1]
+        if( numActive == 0 )
+            return false;
         
-        // then render our FFT data..
-        forwardFFT->performFrequencyOnlyForwardTransform (fftData.data());  // [2]
+        //the ballistics follow the audio time between the frames we actually analyzed
+        auto frameSeconds = sampleRate > 0.0 ? double(windowStart - lastWindowStart) / sampleRate : 0.0;
+        frameSeconds = juce::jlimit(0.0, 1.0, frameSeconds);
+        lastWindowStart = windowStart;
         
-        int numBins = (int)fftSize / 2;
+        const auto averageCoefficient = float(1.0 - std::exp(-frameSeconds / averageSeconds));
+        const auto peakDecay = float(peakDecayDecibelsPerSecond * frameSeconds);
         
-        //normalize the fft values.
-        for( int i = 0; i < numBins; ++i )
+        /*
+         two real signals share one complex FFT: x goes in the real part, y in the imaginary part,
+         and the two spectra come apart again as X[k] = (Z[k] + Z*[N-k]) / 2 and Y[k] = (Z[k] - Z*[N-k]) / 2i.
+         */
+        for( int p = 0; p < numActive; p += 2 )
         {
-            auto v = fftData[i];
-//            fftData[i] /= (float) numBins;
-            if( !std::isinf(v) && !std::isnan(v) )
+            const auto traceX = active[(size_t)p];
+            const auto traceY = p + 1 < numActive ? active[(size_t)p + 1] : -1;
+            
+            // first apply a windowing function to our data, straight out of the ring and across its wrap   // [1]
+            if( ! readTrace(sources[(size_t)traceX], windowStart, windowed.data()) )
+                return false;
+            
+            if( traceY >= 0 )
             {
-                v /= float(numBins);
+                if( ! readTrace(sources[(size_t)traceY], windowStart, windowedB.data()) )
+                    return false;
             }
             else
             {
-                v = 0.f;
+                juce::FloatVectorOperations::clear(windowedB.data(), windowSize);
             }
-            fftData[i] = v;
+            
+            for( int i = 0; i < windowSize; ++i )
+                fftInput[(size_t)i] = { windowed[(size_t)i], windowedB[(size_t)i] };
+            
+            //zero padding
+            std::fill(fftInput.begin() + windowSize, fftInput.begin() + fftSize, Complex());
+            
+            // then render our FFT data..
+            plans->getFFT(order + zeroPadOrder).perform(fftInput.data(), fftOutput.data(), false);  // [2]
+            
+            auto* magnitudesX = bins.data() + traceX * numBins;
+            auto* magnitudesY = traceY >= 0 ? bins.data() + traceY * numBins : nullptr;
+            const auto mask = fftSize - 1;
+            
+            for( int k = 0; k < numBins; ++k )
+            {
+                const auto z = fftOutput[(size_t)k];
+                const auto w = fftOutput[(size_t)((fftSize - k) & mask)];
+                
+                magnitudesX[k] = 0.5f * std::sqrt(juce::square(z.real() + w.real()) + juce::square(z.imag() - w.imag()));
+                
+                if( magnitudesY != nullptr )
+                    magnitudesY[k] = 0.5f * std::sqrt(juce::square(z.real() - w.real()) + juce::square(z.imag() + w.imag()));
+            }
+            
+            //normalize, convert to decibels and average in one pass.
+            //padding adds bins, not energy, so the normalization goes by the window length
+            const auto scale = 1.f / float(windowSize / 2);
+            
+            kernels[(size_t)traceX].process(magnitudesX, magnitudesX, numBins, scale, negativeInfinity,
+                                            mode, averageCoefficient, peakDecay);
+            
+            if( magnitudesY != nullptr )
+                kernels[(size_t)traceY].process(magnitudesY, magnitudesY, numBins, scale, negativeInfinity,
+                                                mode, averageCoefficient, peakDecay);
         }
         
-        //convert them to decibels
-        for( int i = 0; i < numBins; ++i )
-        {
-            fftData[i] = juce::Decibels::gainToDecibels(fftData[i], negativeInfinity);
-        }
+        fftData.fftSize = fftSize;
+        fftData.windowEnd = windowStart + windowSize;
+        fftData.traces = 0;
+        
+        for( int p = 0; p < numActive; ++p )
+            fftData.traces |= 1 << active[(size_t)p];
         
         fftDataFifo.push(fftData);
+        return true;
     }
     
-    void changeOrder(FFTOrder newOrder)
+    /*
+     adds the window starting at 'windowStart' to 'transfer', with trace 0 as the input and
+     trace 1 as the output. both go through one FFT, the same way two traces do above.
+     returns false if the audio thread overwrote either of them while we read it.
+     */
+    bool produceTransferFunction(SampleRing::Position windowStart, double sampleRate, TransferFunction& transfer)
     {
-        //when you change order, recreate the window, forwardFFT, fifo, fftData
-        //also reset the fifoIndex
-        //things that need recreating should be created on the heap via std::make_unique<>
+        const auto windowSize = getWindowSize();
+        const auto fftSize = getFFTSize();
         
-        order = newOrder;
-        auto fftSize = getFFTSize();
+        if( sources[0].a == nullptr || sources[1].a == nullptr )
+            return false;
         
-        forwardFFT = std::make_unique<juce::dsp::FFT>(order);
-        window = std::make_unique<juce::dsp::WindowingFunction<float>>(fftSize, juce::dsp::WindowingFunction<float>::blackmanHarris);
+        if( ! readTrace(sources[0], windowStart, windowed.data()) || ! readTrace(sources[1], windowStart, windowedB.data()) )
+            return false;
         
-        fftData.clear();
-        fftData.resize(fftSize * 2, 0);
-
-        fftDataFifo.prepare(fftData.size());
+        auto frameSeconds = sampleRate > 0.0 ? double(windowStart - lastWindowStart) / sampleRate : 0.0;
+        frameSeconds = juce::jlimit(0.0, 1.0, frameSeconds);
+        lastWindowStart = windowStart;
+        
+        for( int i = 0; i < windowSize; ++i )
+            fftInput[(size_t)i] = { windowed[(size_t)i], windowedB[(size_t)i] };
+        
+        std::fill(fftInput.begin() + windowSize, fftInput.begin() + fftSize, Complex());
+        plans->getFFT(order + zeroPadOrder).perform(fftInput.data(), fftOutput.data(), false);
+        
+        transfer.addFrame(fftOutput.data(), fftSize, float(1.0 - std::exp(-frameSeconds / TransferFunction::averageSeconds)));
+        return true;
+    }
+    
+    /*
+     picks one of the preallocated plans, nothing is allocated or reset.
+     frames already in the fifo keep the size they were made with.
+     */
+    void setResolution(FFTOrder newOrder, int zeroPadFactor)
+    {
+        auto newZeroPadOrder = zeroPadFactor >= 4 ? 2 : zeroPadFactor >= 2 ? 1 : 0;
+        
+        //averages of the old bins mean nothing at the new size
+        if( newOrder != order || newZeroPadOrder != zeroPadOrder )
+            for( auto& kernel : kernels )
+                kernel.reset();
+        
+        order = newOrder;
+        zeroPadOrder = newZeroPadOrder;
     }
+    
+    void setMode(SpectrumKernel::Mode newMode) { mode = newMode; }
     //==============================================================================
-    int getFFTSize() const { return 1 << order; }
+    int getWindowSize() const { return 1 << order; }
+    int getFFTSize() const { return 1 << (order + zeroPadOrder); }
     int getNumAvailableFFTDataBlocks() const { return fftDataFifo.getNumAvailableForReading(); }
     //==============================================================================
-    bool getFFTData(BlockType& fftData) { return fftDataFifo.pull(fftData); }
+    bool getFFTData(BlockType& frame) { return fftDataFifo.pull(frame); }
 private:
-    FFTOrder order;
+    using Complex = juce::dsp::Complex<float>;
+    
+    FFTOrder order = FFTOrder::order2048;
+    int zeroPadOrder = 0;
     BlockType fftData;
-    std::unique_ptr<juce::dsp::FFT> forwardFFT;
-    std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
+    const FFTPlans* plans = nullptr;
+    
+    TraceSources sources;
+    std::array<SpectrumKernel, FFTFrame::maxTraces> kernels;
+    SpectrumKernel::Mode mode = SpectrumKernel::Mode::Instant;
+    SampleRing::Position lastWindowStart = 0;
+    
+    std::vector<float> windowed, windowedB, mixScratch;
+    std::vector<Complex> fftInput, fftOutput;
+    
+    static constexpr double averageSeconds = 0.5;
+    static constexpr double peakDecayDecibelsPerSecond = 12.0;
+    
+    //the producer and consumer both live on the analyzer thread, a few slots is plenty
+    Fifo<BlockType, 4> fftDataFifo;
+    
+    bool readTrace(const TraceSource& source, SampleRing::Position windowStart, float* dest)
+    {
+        if( ! readWindow(*source.a, windowStart, dest) )
+            return false;
+        
+        const auto windowSize = getWindowSize();
+        
+        if( source.b == nullptr )
+        {
+            if( source.gainA != 1.f )
+                juce::FloatVectorOperations::multiply(dest, source.gainA, windowSize);
+            
+            return true;
+        }
+        
+        //the window is linear, so mixing after windowing is the same as before
+        if( ! readWindow(*source.b, windowStart, mixScratch.data()) )
+            return false;
+        
+        juce::FloatVectorOperations::multiply(dest, source.gainA, windowSize);
+        juce::FloatVectorOperations::addWithMultiply(dest, mixScratch.data(), source.gainB, windowSize);
+        return true;
+    }
     
-    Fifo<BlockType> fftDataFifo;
+    bool readWindow(const SampleRing& ring, SampleRing::Position windowStart, float* dest) const
+    {
+        auto numToRead = getWindowSize();
+        auto* windowIndex = plans->getWindow(order).data();
+        
+        if( windowStart < 0 )
+        {
+            auto numSilent = (int)juce::jmin<SampleRing::Position>(-windowStart, numToRead);
+            juce::FloatVectorOperations::clear(dest, numSilent);
+            dest += numSilent;
+            windowIndex += numSilent;
+            numToRead -= numSilent;
+            windowStart = 0;
+        }
+        
+        auto region = ring.getRegion(windowStart, numToRead);
+        juce::FloatVectorOperations::multiply(dest, region.data1, windowIndex, region.size1);
+        juce::FloatVectorOperations::multiply(dest + region.size1, region.data2, windowIndex + region.size1, region.size2);
+        
+        return numToRead == 0 || ring.isStillValid(windowStart);
+    }
+};
+
+/*
+ decides which windows of the ring get analyzed: one every hop, however the host
+ happens to block its audio, and never more often than the display can use them.
+ */
+struct FFTScheduler
+{
+    void setOverlap(float newOverlap) { overlap = juce::jlimit(0.f, 0.9375f, newOverlap); }
+    float getOverlap() const { return overlap; }
+    
+    //may be called from any thread, the next tick picks it up
+    void setMaxFramesPerSecond(double newMax) { maxFramesPerSecond = juce::jmax(1.0, newMax); }
+    
+    int getHopSize(int fftSize) const { return juce::jmax(1, juce::roundToInt(fftSize * (1.f - overlap))); }
+    
+    /*
+     call once per tick. returns how many windows to analyze now, and drops the
+     older hops whenever there are more than the frame rate allows.
+     */
+    int schedule(SampleRing& ring, int fftSize)
+    {
+        hopSize = getHopSize(fftSize);
+        
+        auto now = juce::Time::getMillisecondCounterHiRes();
+        budget += lastTickTime > 0.0 ? (now - lastTickTime) * 0.001 * maxFramesPerSecond : 1.0;
+        lastTickTime = now;
+        
+        //a late tick may catch up by one frame, not by a burst
+        budget = juce::jmin(budget, 2.0);
+        
+        auto numHops = ring.getNumUnread() / hopSize;
+        auto numFrames = juce::jmin(numHops, (int)budget);
+        
+        if( numFrames > 0 )
+        {
+            //the newest audio is the one worth showing
+            ring.advance((numHops - numFrames) * hopSize);
+            budget -= numFrames;
+        }
+        
+        return numFrames;
+    }
+    
+    /*
+     how long until the next window is both filled and allowed by the frame rate.
+     */
+    double getMillisecondsUntilNextFrame(SampleRing& ring, int fftSize, double sampleRate)
+    {
+        auto hop = getHopSize(fftSize);
+        auto samplesNeeded = juce::jmax(0, hop - ring.getNumUnread());
+        auto msUntilFilled = sampleRate > 0.0 ? 1000.0 * samplesNeeded / sampleRate : 0.0;
+        
+        auto elapsed = lastTickTime > 0.0 ? juce::Time::getMillisecondCounterHiRes() - lastTickTime : 0.0;
+        auto framesAllowed = budget + elapsed * 0.001 * maxFramesPerSecond;
+        auto msUntilAllowed = juce::jmax(0.0, (1.0 - framesAllowed) * 1000.0 / maxFramesPerSecond);
+        
+        return juce::jmax(msUntilFilled, msUntilAllowed);
+    }
+    
+    /*
+     start of the next window to analyze, for each of the frames schedule() returned.
+     */
+    SampleRing::Position getNextWindow(SampleRing& ring, int fftSize)
+    {
+        ring.advance(hopSize);
+        return ring.getReadPosition() - fftSize;
+    }
+private:
+    float overlap = 0.75f;
+    std::atomic<double> maxFramesPerSecond { 60.0 };
+    
+    int hopSize = 1;
+    double budget = 0.0;
+    double lastTickTime = 0.0;
 };
 
 template<typename PathType>
 struct AnalyzerPathGenerator
 {
     /*
-     converts 'renderData[]' into a juce::Path
+     one FFT's worth of decibels for a trace, and the width of its bins in Hz.
+     */
+    struct Band
+    {
+        const float* bins = nullptr;
+        int numBins = 0;
+        float binWidth = 0.f;
+    };
+    
+    /*
+     makes room for the smoothing sums of the largest FFT, so switching smoothing on later
+     allocates nothing. call it from the thread that generates the paths.
+     */
+    void prepare(int maxFFTSize)
+    {
+        for( auto& sums : powerSums )
+            sums.reserve((size_t)maxFFTSize / 2 + 1);
+    }
+    
+    /*
+     fractional octave smoothing: 3, 6 or 12 for 1/3, 1/6 or 1/12 octave, 0 for none.
+     */
+    void setSmoothing(int newOctaveFraction)
+    {
+        if( newOctaveFraction != octaveFraction )
+        {
+            octaveFraction = newOctaveFraction;
+            columnWidth = 0; //rebuild the table
+        }
+    }
+    
+    /*
+     converts 'renderData[]' into a juce::Path with one vertex per pixel column
      */
-    void generatePath(const std::vector<float>& renderData,
+    void generatePath(const float* renderData,
                       juce::Rectangle<float> fftBounds,
                       int fftSize,
                       float binWidth,
                       float negativeInfinity)
+    {
+        generatePath({ renderData, fftSize / 2, binWidth }, {}, 0.f, fftBounds, negativeInfinity);
+    }
+    
+    /*
+     the same, stitched from two bands: columns below 'crossoverFrequency' come from
+     lowBand (if it has any bins), the rest from band.
+     */
+    void generatePath(const Band& band,
+                      const Band& lowBand,
+                      float crossoverFrequency,
+                      juce::Rectangle<float> fftBounds,
+                      float negativeInfinity)
     {
         auto top = fftBounds.getY();
         auto bottom = fftBounds.getHeight();
-        auto width = fftBounds.getWidth();
-
-        int numBins = (int)fftSize / 2;
+        auto width = juce::jmax(1, (int)fftBounds.getWidth());
+        
+        const Band bands[] { band, lowBand.bins != nullptr ? lowBand : Band() };
+        
+        updateColumns(width, bands, crossoverFrequency);
+        
+        //smoothing averages power, running sums make every column's mean O(1) however many bins it spans
+        if( octaveFraction > 0 )
+        {
+            for( size_t b = 0; b < powerSums.size(); ++b )
+            {
+                auto& sums = powerSums[b];
+                sums.resize((size_t)bands[b].numBins + 1);
+                sums[0] = 0.0;
+                
+                for( int i = 0; i < bands[b].numBins; ++i )
+                    sums[(size_t)i + 1] = sums[(size_t)i] + std::pow(10.0, 0.1 * bands[b].bins[i]);
+            }
+        }
 
-        PathType p;
-        p.preallocateSpace(3 * (int)fftBounds.getWidth());
+        //reuses whatever storage the last swap handed back
+        auto& p = path;
+        p.clear();
+        p.preallocateSpace(3 * width + 3);
 
         auto map = [bottom, top, negativeInfinity](float v)
         {
@@ -124,29 +520,43 @@ struct AnalyzerPathGenerator
                               float(bottom+10),   top);
         };
 
-        auto y = map(renderData[0]);
-
-//        jassert( !std::isnan(y) && !std::isinf(y) );
-        if( std::isnan(y) || std::isinf(y) )
-            y = bottom;
-        
-        p.startNewSubPath(0, y);
-
-        const int pathResolution = 2; //you can draw line-to's every 'pathResolution' pixels.
-
-        for( int binNum = 1; binNum < numBins; binNum += pathResolution )
+        for( int x = 0; x < width; ++x )
         {
-            y = map(renderData[binNum]);
-
-//            jassert( !std::isnan(y) && !std::isinf(y) );
-
-            if( !std::isnan(y) && !std::isinf(y) )
+            const auto& column = columns[(size_t)x];
+            const auto* renderData = bands[column.band].bins;
+            const auto numBins = bands[column.band].numBins;
+            float v;
+            
+            if( column.end <= column.start )
+            {
+                //narrower than a bin: interpolate instead of stepping from bin to bin
+                auto i = (int)column.position;
+                auto frac = column.position - (float)i;
+                auto next = juce::jmin(i + 1, numBins - 1);
+                v = renderData[i] + frac * (renderData[next] - renderData[i]);
+            }
+            else if( octaveFraction > 0 )
             {
-                auto binFreq = binNum * binWidth;
-                auto normalizedBinX = juce::mapFromLog10(binFreq, 20.f, 20000.f);
-                int binX = std::floor(normalizedBinX * width);
-                p.lineTo(binX, y);
+                const auto& sums = powerSums[(size_t)column.band];
+                auto mean = (sums[(size_t)column.end] - sums[(size_t)column.start]) / double(column.end - column.start);
+                v = juce::jmax(negativeInfinity, float(10.0 * std::log10(juce::jmax(mean, 1.0e-30))));
             }
+            else
+            {
+                //the loudest bin in the column, so narrow peaks survive the decimation
+                v = *std::max_element(renderData + column.start, renderData + column.end);
+            }
+            
+            levels[(size_t)x] = v;
+            auto y = map(v);
+            
+            if( std::isnan(y) || std::isinf(y) )
+                y = bottom;
+            
+            if( x == 0 )
+                p.startNewSubPath(0, y);
+            else
+                p.lineTo((float)x, y);
         }
 
         pathFifo.push(p);
@@ -161,8 +571,83 @@ struct AnalyzerPathGenerator
     {
         return pathFifo.pull(path);
     }
+    
+    /*
+     the decibels behind the last path, one per pixel column.
+     */
+    const std::vector<float>& getLevels() const { return levels; }
 private:
-    Fifo<PathType> pathFifo;
+    PathType path;
+    std::vector<float> levels;
+    Fifo<PathType, 4> pathFifo;
+    
+    /*
+     the bins [start, end) of 'band' that make up one pixel column, or where to interpolate when none do.
+     */
+    struct ColumnSpan
+    {
+        int start = 0, end = 0;
+        float position = 0.f;
+        int band = 0;
+    };
+    
+    std::vector<ColumnSpan> columns;
+    std::array<std::vector<double>, 2> powerSums;
+    int octaveFraction = 0;
+    
+    //what the table was built for
+    int columnWidth = 0;
+    std::array<int, 2> columnNumBins {};
+    std::array<float, 2> columnBinWidth {};
+    float columnCrossover = 0.f;
+    
+    /*
+     only does any work (or allocates) when the width, FFT sizes, sample rate, crossover or smoothing changed.
+     */
+    void updateColumns(int width, const Band (&bands)[2], float crossoverFrequency)
+    {
+        if( width == columnWidth
+           && bands[0].numBins == columnNumBins[0] && bands[0].binWidth == columnBinWidth[0]
+           && bands[1].numBins == columnNumBins[1] && bands[1].binWidth == columnBinWidth[1]
+           && crossoverFrequency == columnCrossover )
+            return;
+        
+        columnWidth = width;
+        columnCrossover = crossoverFrequency;
+        
+        for( size_t b = 0; b < 2; ++b )
+        {
+            columnNumBins[b] = bands[b].numBins;
+            columnBinWidth[b] = bands[b].binWidth;
+        }
+        
+        columns.resize((size_t)width);
+        levels.resize((size_t)width);
+        
+        const auto halfSpan = octaveFraction > 0 ? std::pow(2.0, 0.5 / octaveFraction) : 1.0;
+        
+        for( int x = 0; x < width; ++x )
+        {
+            auto low = juce::mapToLog10(double(x) / width, 20.0, 20000.0);
+            auto high = juce::mapToLog10(double(x + 1) / width, 20.0, 20000.0);
+            auto centre = juce::mapToLog10((x + 0.5) / width, 20.0, 20000.0);
+            
+            auto& column = columns[(size_t)x];
+            column.band = bands[1].numBins > 0 && centre < crossoverFrequency ? 1 : 0;
+            
+            const auto numBins = bands[column.band].numBins;
+            const auto binWidth = (double)bands[column.band].binWidth;
+            
+            auto binFor = [binWidth, numBins](double freq)
+            {
+                return juce::jlimit(0, numBins, (int)std::ceil(freq / binWidth));
+            };
+            
+            column.start = binFor(juce::jmin(low, centre / halfSpan));
+            column.end = binFor(juce::jmax(high, centre * halfSpan));
+            column.position = (float)juce::jlimit(0.0, double(numBins - 1), centre / binWidth);
+        }
+    }
 };
 
 struct LookAndFeel : juce::LookAndFeel_V4
@@ -175,6 +660,37 @@ struct LookAndFeel : juce::LookAndFeel_V4
                            juce::Slider&) override ;
 };
 
+/*
+ what every editor can share. hold it through a juce::SharedResourcePointer<SharedEditorResources>:
+ the processor keeps one from its first createEditor() on, so closing the last editor
+ doesn't throw away what the next one would only build again.
+ */
+struct SharedEditorResources
+{
+    SharedEditorResources();
+    
+    LookAndFeel lookAndFeel;
+    
+    //the spectrogram's colour map, one colour per level index
+    std::array<juce::PixelARGB, 256> spectrogramColours;
+    
+    /*
+     the plans are what takes longest to build, so they're left to the first analyzer that
+     has audio to look at. analyzer thread only, which there's one of.
+     */
+    const FFTPlans& getFFTPlans()
+    {
+        if( fftPlans == nullptr )
+            fftPlans = std::make_unique<FFTPlans>();
+        
+        return *fftPlans;
+    }
+private:
+    std::unique_ptr<FFTPlans> fftPlans;
+    
+    JUCE_DECLARE_NON_COPYABLE(SharedEditorResources)
+};
+
 struct RotarySliderWithLabels : juce::Slider
 {
     RotarySliderWithLabels(juce::RangedAudioParameter& rap, const juce::String& unitSuffix) : juce::Slider(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag,
@@ -182,7 +698,7 @@ struct RotarySliderWithLabels : juce::Slider
     param(&rap),
     suffix(unitSuffix)
     {
-        setLookAndFeel(&lnf);
+        setLookAndFeel(&resources->lookAndFeel);
     }
     
     ~RotarySliderWithLabels()
@@ -205,13 +721,242 @@ struct RotarySliderWithLabels : juce::Slider
     juce::String getDisplayString() const;
     
 private:
-    LookAndFeel lnf;
+    juce::SharedResourcePointer<SharedEditorResources> resources;
     
     juce::RangedAudioParameter* param;
     juce::String suffix;
     
 };
 
+/*
+ everything between the sample tap and a finished path. analyze() runs on the shared
+ AnalyzerThread, the message thread only sets the bounds and picks up paths.
+ */
+struct SpectrumAnalyzer : AnalyzerThread::Client
+{
+    /*
+     which channels get a trace. the first two traces are post-EQ, traces 2 and 3
+     are the same channels before the EQ, when that overlay is on.
+     */
+    enum class ChannelView
+    {
+        Left,
+        Stereo,
+        MidSide
+    };
+    
+    SpectrumAnalyzer(JhanEQAudioProcessor& p, MatchEQ& m);
+    
+    void setBounds(juce::Rectangle<float> newBounds);
+    
+    /*
+     swaps in the newest finished path for 'trace'. returns false if there wasn't one.
+     */
+    bool getPath(int trace, juce::Path& path);
+    
+    /*
+     only while the analyzer isn't a client of the thread, and with getTaps() of the
+     new view attached to the processor.
+     */
+    void setView(ChannelView newView, bool showPreEQ);
+    
+    //the analyzer taps this view reads
+    int getTaps() const;
+    //bit t set for every trace this view draws
+    int getTraces() const;
+    
+    /*
+     safe to call from the message thread at any time, it's picked up before the next frame.
+     */
+    void setResolution(FFTOrder order, int zeroPadFactor);
+    void setMode(SpectrumKernel::Mode mode);
+    void setSmoothing(int octaveFraction);
+    //at most as many frames as the display asks for
+    void setMaxFramesPerSecond(double framesPerSecond) { fftScheduler.setMaxFramesPerSecond(framesPerSecond); }
+    
+    /*
+     multi resolution: below lowBandCrossover the traces come from a 2048 point FFT
+     of the signal decimated to around 6 kHz, which has bins 8 times (or more) finer
+     than the main FFT for less than the cost of one 8192 point FFT.
+     */
+    void setMultiResolution(bool shouldBeOn);
+    
+    /*
+     the spectrogram gets one row of colour indices (0 = the floor, 255 = 0 dB) for every
+     historySeconds / numRows of audio, at most one per frame. each row holds the loudest
+     level every pixel column of the first trace reached in that time. 0 seconds turns it off.
+     */
+    void setSpectrogram(double historySeconds, int numRows);
+    bool getSpectrogramRow(std::vector<juce::uint8>& row);
+    
+    /*
+     measures the response from the pre EQ to the post EQ left channel on whatever is playing,
+     one window per display frame. same rules as setView: only while the analyzer isn't a
+     client, and with getTaps() of the new state attached to the processor.
+     */
+    void setMeasuring(bool shouldMeasure);
+    bool isMeasuring() const { return measuring; }
+    
+    /*
+     the match capture listens to the left channel before the EQ, so neither the current
+     settings nor a change between the two captures ends up in the fit. same rules as setView.
+     */
+    void setCapturing(bool shouldCapture) { capturing = shouldCapture; }
+    
+    /*
+     the response on the response curve's scale, left out wherever the coherence is below
+     minCoherence, and the coherence itself (0 to 1) along the bottom quarter. x starts at 0
+     like the traces.
+     */
+    struct TransferPaths
+    {
+        juce::Path response, coherence;
+    };
+    
+    static constexpr float minCoherence = 0.5f;
+    
+    /*
+     swaps in the newest measured paths. returns false if there weren't any new ones.
+     */
+    bool getTransferPaths(TransferPaths& paths);
+    
+    /*
+     nothing the FFTs need is allocated until the first audio arrives, and then it's
+     allocated here, on the analyzer thread, rather than while the editor opens.
+     */
+    double analyze() override;
+private:
+    JhanEQAudioProcessor& audioProcessor;
+    MatchEQ& matchEQ;
+    SampleRing& leftChannelRing;
+    
+    juce::SharedResourcePointer<SharedEditorResources> resources;
+    void prepareResources();
+    
+    ChannelView view = ChannelView::Left;
+    bool preEQ = false;
+    
+    juce::SpinLock boundsLock;
+    juce::Rectangle<float> fftBounds;
+    
+    FFTScheduler fftScheduler;
+    
+    std::atomic<int> pendingOrder { FFTOrder::order2048 }, pendingZeroPadFactor { 1 };
+    int currentOrder = FFTOrder::order2048, currentZeroPadFactor = 1;
+    std::atomic<SpectrumKernel::Mode> pendingMode { SpectrumKernel::Mode::Instant };
+    std::atomic<int> pendingSmoothing { 0 };
+    std::atomic<bool> pendingMultiResolution { false };
+    bool multiResolution = false;
+    
+    //every trace of the view, packed two per FFT
+    FFTDataGenerator<FFTFrame>::TraceSources viewSources;
+    FFTDataGenerator<FFTFrame> viewFFTDataGenerator;
+    
+    //persistent so pulling frames out of the generator just swaps storage
+    FFTFrame viewFFTData;
+    
+    //runs with a much lower floor than the display, only while a match capture is active
+    FFTDataGenerator<FFTFrame> matchFFTDataGenerator;
+    FFTFrame matchFFTData;
+    
+    /*
+     the multi resolution low band. every trace of the view is mixed and decimated
+     into its own small ring here on the analyzer thread, the audio thread never sees it.
+     */
+    static constexpr float lowBandCrossover = 500.f;
+    static constexpr double lowBandTargetRate = 6000.0;
+    static constexpr int lowBandBlockSize = 4096;
+    
+    std::array<HalfBandDecimator, FFTFrame::maxTraces> lowBandDecimators;
+    std::array<SampleRing, FFTFrame::maxTraces> lowBandRings;
+    std::vector<float> lowBandInput, lowBandMix;
+    
+    //next input sample to decimate, the same for every trace since the taps are aligned. -1 restarts
+    SampleRing::Position lowBandPosition = -1;
+    double lowBandSampleRate = 0.0;
+    
+    FFTDataGenerator<FFTFrame> lowBandFFTDataGenerator;
+    FFTFrame lowBandFFTData;
+    
+    void decimateLowBand(double sampleRate);
+    
+    std::atomic<double> pendingSpectrogramSeconds { 0.0 };
+    std::atomic<int> pendingSpectrogramRows { 0 };
+    double spectrogramSeconds = 0.0;
+    int spectrogramNumRows = 0;
+    
+    //the row being accumulated, and the audio position it started at (-1 = not started)
+    std::vector<float> spectrogramLevels;
+    SampleRing::Position spectrogramRowStart = -1;
+    std::vector<juce::uint8> spectrogramRow;
+    Fifo<std::vector<juce::uint8>, 16> spectrogramRows;
+    
+    void addToSpectrogram(const std::vector<float>& levels, SampleRing::Position frameEnd, double sampleRate, float negativeInfinity);
+    
+    bool capturing = false;
+    
+    //trace 0 is the input, trace 1 the output. the spectra are averaged, the paths only built once per tick
+    bool measuring = false;
+    FFTDataGenerator<FFTFrame> transferFFTDataGenerator;
+    TransferFunction transferFunction;
+    std::vector<float> transferLevels, transferCoherence;
+    TransferPaths transferPaths;
+    Fifo<TransferPaths, 4> transferPathFifo;
+    
+    void generateTransferPaths(juce::Rectangle<float> bounds, double sampleRate);
+    
+    std::array<AnalyzerPathGenerator<juce::Path>, FFTFrame::maxTraces> pathProducers;
+};
+
+/*
+ part of a component, rasterized at the display's scale and then only composited
+ until it's invalidated. the content is drawn in component coordinates and clipped
+ to the layer's area.
+ */
+struct RenderLayer
+{
+    void invalidate() { needsRedraw = true; }
+    
+    template<typename DrawContent>
+    void draw(juce::Graphics& g, juce::Rectangle<int> area, bool isOpaque, DrawContent&& drawContent)
+    {
+        using namespace juce;
+        
+        if( area.isEmpty() )
+            return;
+        
+        //the physical scale of the context, so HiDPI displays get a pixel for every pixel
+        const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        
+        if( needsRedraw || scale != imageScale || area != imageArea )
+        {
+            const auto width = jmax(1, roundToInt(area.getWidth() * scale));
+            const auto height = jmax(1, roundToInt(area.getHeight() * scale));
+            
+            if( image.getWidth() != width || image.getHeight() != height )
+                image = Image(isOpaque ? Image::RGB : Image::ARGB, width, height, true);
+            else
+                image.clear(image.getBounds());
+            
+            Graphics layer(image);
+            layer.addTransform(AffineTransform::translation((float)-area.getX(), (float)-area.getY())
+                               .scaled((float)width / area.getWidth(), (float)height / area.getHeight()));
+            drawContent(layer);
+            
+            imageScale = scale;
+            imageArea = area;
+            needsRedraw = false;
+        }
+        
+        g.drawImage(image, area.toFloat());
+    }
+private:
+    juce::Image image;
+    float imageScale = 0.f;
+    juce::Rectangle<int> imageArea;
+    bool needsRedraw = true;
+};
+
 struct ResponseCurveComponent: juce::Component,
 juce::AudioProcessorParameter::Listener,
 juce::Timer
@@ -220,36 +965,241 @@ juce::Timer
     ~ResponseCurveComponent();
     void parameterValueChanged (int parameterIndex, float newValue) override;
     
-    void parameterGestureChanged (int parameterIndex, bool gestureIsStarting) override { }
+    void parameterGestureChanged (int parameterIndex, bool gestureIsStarting) override;
     
     void timerCallback() override;
     
     void paint(juce::Graphics& g) override;
     void resized() override;
+    void visibilityChanged() override;
+    void parentHierarchyChanged() override;
+    
+    MatchEQ& getMatchEQ() { return matchEQ; }
+    
+    /*
+     starts or stops a match capture, attaching the pre EQ tap it listens to for as long as it runs.
+     */
+    void setMatchCapture(MatchEQ::Capture capture);
+    
+    void setAnalyzerResolution(FFTOrder order, int zeroPadFactor) { analyzer.setResolution(order, zeroPadFactor); }
+    void setAnalyzerMode(SpectrumKernel::Mode mode) { analyzer.setMode(mode); }
+    void setAnalyzerSmoothing(int octaveFraction) { analyzer.setSmoothing(octaveFraction); }
+    void setAnalyzerMultiResolution(bool shouldBeOn) { analyzer.setMultiResolution(shouldBeOn); }
+    void setAnalyzerView(SpectrumAnalyzer::ChannelView view, bool showPreEQ);
+    
+    /*
+     shows the spectrogram under the curve with this much history, 0 hides it.
+     the component needs getSpectrogramHeight() more room while it's showing.
+     */
+    void setSpectrogramHistory(double seconds);
+    int getSpectrogramHeight() const { return spectrogramSeconds > 0.0 ? spectrogramStripHeight : 0; }
+    
+    /*
+     the most frames per second the display runs at while something is changing.
+     */
+    void setMaxFrameRate(int framesPerSecond);
+    
+    /*
+     overlays the response measured between the input and the output on the designed one.
+     */
+    void setTransferMeasurement(bool shouldMeasure);
+    
+    /*
+     ResponseKernel::Curves flags for the curves drawn over the magnitude. they're worked
+     out with it, so they only cost anything when the coefficients change.
+     */
+    void setResponseCurves(int curves);
 private:
     JhanEQAudioProcessor& audioProcessor;
     juce::Atomic<bool> parametersChanged { false };
     
-    MonoChain monoChain;
+    /*
+     Active refreshes at up to maxFrameRate, synced to the display's vblank where JUCE
+     has it. with nothing new to show for idleAfterMs the timer drops to idleFrameRate,
+     which is still fast enough to notice audio or automation coming back. while the
+     component isn't showing (hidden, minimised, or the editor closed in the host) the
+     analyzer stops and the timer only checks whether it's back.
+     */
+    enum class Pace
+    {
+        Active,
+        Idle,
+        Suspended
+    };
+    
+    static constexpr int idleFrameRate = 10;
+    static constexpr int suspendedFrameRate = 2;
+    static constexpr double idleAfterMs = 500.0;
+    
+    Pace pace = Pace::Suspended;
+    int maxFrameRate = 60;
+    double lastChangeMs = 0.0, lastFrameMs = 0.0;
+    
+    void setPace(Pace newPace);
+    void resumeIfShowing();
+    void refresh();
+    
+   #if JUCE_MAJOR_VERSION >= 7
+    std::unique_ptr<juce::VBlankAttachment> vBlankAttachment;
+   #endif
     
+    /*
+     normally a copy of the processor's snapshot. designing here is only the stand-in
+     for when the audio thread isn't running, so nothing gets published.
+     */
+    ChainCoefficients chainCoefficients;
+    double chainSampleRate = 0.0;
+    VersionedSnapshot<ChainSnapshot>::Version chainVersion = 0;
+    double parametersChangedMs = 0.0;
+    static constexpr double snapshotTimeoutMs = 100.0;
+    
+    bool pullChainSnapshot();
     void updateChain();
     
-    juce::Image background;
+    /*
+     the curve is only worked out again when the coefficients, the size or the sample rate
+     change, and only at every ResponseKernel::coarseStep'th column while a slider is held.
+     */
+    ResponseKernel responseKernel;
+    juce::Path responseCurve;
+    bool responseCurveIsCoarse = false;
+    
+    //phase is scaled to the nearest 180 degrees above its peak, delay to the nearest 1, 2, 5 ms
+    int responseCurves = 0;
+    juce::Path phaseCurve, groupDelayCurve;
+    float phaseRange = 0.f, groupDelayRange = 0.f;
+    std::atomic<int> numGesturesInProgress { 0 };
+    
+    void updateResponseCurve(bool coarse);
+    
+    //the grid is redrawn when the size or scale changes, the curve when it changes as well
+    RenderLayer gridLayer, curveLayer;
+    void drawGrid(juce::Graphics& g);
     
     juce::Rectangle<int> getRenderArea();
     
     juce::Rectangle<int> getAnalysisArea();
     
-    SingleChannelSampleFifo<JhanEQAudioProcessor::BlockType>* leftChannelFifo;
+    std::array<juce::Path, FFTFrame::maxTraces> analyzerPaths;
+    int analyzerTraces = 0;
+    SpectrumAnalyzer::TransferPaths measuredPaths;
+    
+    /*
+     a ring of rows: new rows overwrite the oldest one and paint() draws the image in two
+     pieces starting at the newest, so nothing is ever scrolled.
+     */
+    static constexpr int spectrogramStripHeight = 56;
+    double spectrogramSeconds = 0.0;
+    juce::Image spectrogram;
+    int spectrogramNewestRow = 0;
+    std::vector<juce::uint8> spectrogramData;
+    juce::SharedResourcePointer<SharedEditorResources> resources;
+    
+    juce::Rectangle<int> getSpectrogramArea();
+    void drawSpectrogramRow(const std::vector<juce::uint8>& row);
     
-    juce::AudioBuffer<float> monoBuffer;
+    MatchEQ matchEQ;
     
-    FFTDataGenerator<std::vector<float>> leftChannelFFTDataGenerator;
+    juce::SharedResourcePointer<AnalyzerThread> analyzerThread;
+    SpectrumAnalyzer analyzer { audioProcessor, matchEQ };
     
-    AnalyzerPathGenerator<juce::Path> pathProducer;
+};
+
+
+struct PresetPanel : juce::Component,
+juce::ListBoxModel,
+juce::ValueTree::Listener
+{
+    PresetPanel(JhanEQAudioProcessor&);
+    ~PresetPanel();
+    
+    int getNumRows() override;
+    void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    void selectedRowsChanged(int lastRowSelected) override;
+    
+    //the processor leaves a morph by itself when a preset is loaded or a band parameter moves
+    void valueTreeChildAdded(juce::ValueTree& parent, juce::ValueTree& child) override;
+    void valueTreeChildRemoved(juce::ValueTree& parent, juce::ValueTree& child, int index) override;
+    
+    void resized() override;
+private:
+    JhanEQAudioProcessor& audioProcessor;
+    
+    juce::TextEditor searchBox;
+    juce::ListBox presetList;
+    
+    juce::TextButton saveButton { "Save" },
+                    setAButton { "A" },
+                    setBButton { "B" },
+                    clearMorphButton { "Clear" };
+    
+    juce::Slider morphSlider { juce::Slider::SliderStyle::LinearHorizontal, juce::Slider::TextEntryBoxPosition::NoTextBox };
+    juce::AudioProcessorValueTreeState::SliderAttachment morphSliderAttachment;
     
-    juce::path leftChannelFFTPath;
+    //only used while there is search text, otherwise a row is simply the preset index
+    juce::Array<int> searchResults;
+    bool isSearching = false;
     
+    int getPresetIndex(int row) const;
+    void updateSearch();
+    void updateMorphControls();
+};
+
+/*
+ output peak / RMS bars per channel, the true-peak maximum and momentary and short-term
+ loudness. the processor only meters while one of these exists. click to reset the
+ true-peak hold.
+ */
+struct LevelMeterComponent : juce::Component,
+juce::Timer
+{
+    LevelMeterComponent(JhanEQAudioProcessor&);
+    ~LevelMeterComponent();
+    
+    void timerCallback() override;
+    void paint(juce::Graphics& g) override;
+    void mouseDown(const juce::MouseEvent&) override;
+private:
+    JhanEQAudioProcessor& audioProcessor;
+    
+    static constexpr float minDecibels = -60.f;
+    static constexpr float peakFallDecibelsPerSecond = 20.f;
+    static constexpr int refreshRate = 30;
+    
+    std::array<float, LevelMeterValues::maxChannels> peakDecibels, rmsDecibels, truePeakHold;
+    float momentaryLUFS = -100.f, shortTermLUFS = -100.f;
+};
+
+/*
+ mid on the vertical axis, side on the horizontal, with the L / R correlation
+ underneath. the points accumulate in an image that fades a little every tick,
+ so a frame costs the same however many points are on screen.
+ */
+struct GoniometerComponent : juce::Component,
+juce::Timer
+{
+    GoniometerComponent(JhanEQAudioProcessor&);
+    ~GoniometerComponent();
+    
+    void timerCallback() override;
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+private:
+    JhanEQAudioProcessor& audioProcessor;
+    
+    static constexpr int refreshRate = 30;
+    static constexpr int maxPointsPerFrame = 2048;
+    static constexpr float persistenceSeconds = 0.1f; //time for a point to fade to half
+    
+    //one byte of intensity per pixel, drawn through the current colour
+    juce::Image trace;
+    std::vector<float> points;
+    float correlation = 0.f;
+    
+    juce::Rectangle<int> getPlotArea() const;
+    juce::Rectangle<int> getCorrelationArea() const;
+    void fadeTrace();
+    void plotPoints(int numPoints);
 };
 
 
@@ -264,14 +1214,25 @@ public:
 
     //==============================================================================
     void paint (juce::Graphics&) override;
+    void paintOverChildren (juce::Graphics&) override;
     void resized() override;
     
+    /*
+     from the start of the constructor to the end of the first paint, and to the end of
+     the constructor on its own. 0 until the first paint.
+     */
+    double getOpenDurationMs() const { return openDurationMs; }
+    double getConstructionDurationMs() const { return constructionDurationMs; }
     
 private:
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     JhanEQAudioProcessor& audioProcessor;
     
+    //initialized before any of the components below are built
+    const double openStartMs = juce::Time::getMillisecondCounterHiRes();
+    double constructionDurationMs = 0, openDurationMs = 0;
+    
     RotarySliderWithLabels peakFreqSlider,
                         peakGainSlider,
                         peakQualitySlider,
@@ -282,6 +1243,24 @@ private:
     
     ResponseCurveComponent responseCurveComponent;
     
+    juce::TextButton captureReferenceButton { "Capture Ref" },
+                    captureInputButton { "Capture Input" },
+                    matchButton { "Match" };
+    
+    juce::ToggleButton autoGainButton;
+    juce::ComboBox autoGainReferenceBox;
+    
+    //analyzer settings aren't parameters, they live in the "Analyzer" child of the state
+    juce::ComboBox analyzerResolutionBox, analyzerZeroPadBox, analyzerModeBox, analyzerSmoothingBox, analyzerChannelsBox, spectrogramBox;
+    juce::ToggleButton analyzerPreEQButton;
+    juce::ComboBox frameRateBox;
+    juce::ToggleButton phaseButton, groupDelayButton;
+    juce::ToggleButton measureButton;
+    
+    PresetPanel presetPanel;
+    LevelMeterComponent levelMeter;
+    GoniometerComponent goniometer;
+    
     using APVTS = juce::AudioProcessorValueTreeState;
     using Attachment = APVTS::SliderAttachment;
     
@@ -292,9 +1271,20 @@ private:
                 lowPassFreqSliderAttachment,
                 highPassSlopeSliderAttachment,
                 lowPassSlopeSliderAttachment;
+    
+    APVTS::ButtonAttachment autoGainButtonAttachment;
+    
+    //created after the items are added, so the attachment can select the current one
+    using ComboBoxAttachment = APVTS::ComboBoxAttachment;
+    std::unique_ptr<ComboBoxAttachment> autoGainReferenceAttachment;
             
     
     std::vector<juce::Component*> getComps();
+    
+    void setMatchCapture(MatchEQ::Capture capture);
+    //the resolution box's ids are FFT orders, apart from this one
+    static constexpr int multiResolutionId = 1;
+    void updateAnalyzerResolution();
   
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (JhanEQAudioProcessorEditor)
 };
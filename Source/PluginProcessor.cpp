@@ -8,6 +8,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "PresetLibrary.h"
 
 //==============================================================================
 JhanEQAudioProcessor::JhanEQAudioProcessor()
@@ -22,10 +23,30 @@ JhanEQAudioProcessor::JhanEQAudioProcessor()
                        )
 #endif
 {
+    presetLibrary = std::make_unique<PresetLibrary>();
+    
+    for( auto* param : getParameters() )
+        param->addListener(this);
+    
+    for( auto id : { "HighPass Freq", "LowPass Freq", "Peak Freq", "Peak Gain", "Peak Quality", "HighPass Slope", "LowPass Slope" } )
+    {
+        if( auto* param = apvts.getParameter(id) )
+            bandParameterIndices.add(param->getParameterIndex());
+    }
+    
+    apvts.state.addListener(this);
+    
+    startTimerHz(10);
 }
 
 JhanEQAudioProcessor::~JhanEQAudioProcessor()
 {
+    stopTimer();
+    
+    apvts.state.removeListener(this);
+    
+    for( auto* param : getParameters() )
+        param->removeListener(this);
 }
 
 //==============================================================================
@@ -68,22 +89,23 @@ double JhanEQAudioProcessor::getTailLengthSeconds() const
 
 int JhanEQAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return juce::jmax(1, presetLibrary->getNumPresets());   // NB: some hosts don't cope very well if you tell them there are 0 programs,
+                                                            // so this should be at least 1, even if you're not really implementing programs.
 }
 
 int JhanEQAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void JhanEQAudioProcessor::setCurrentProgram (int index)
 {
+    loadPreset(index);
 }
 
 const juce::String JhanEQAudioProcessor::getProgramName (int index)
 {
-    return {};
+    return presetLibrary->getName(index);
 }
 
 void JhanEQAudioProcessor::changeProgramName (int index, const juce::String& newName)
@@ -103,14 +125,24 @@ void JhanEQAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock
     spec.numChannels = 1;
     spec.sampleRate = sampleRate;
     
+    prepareCoefficientStorage(leftChain);
+    prepareCoefficientStorage(rightChain);
+    
     leftChain.prepare(spec);
     rightChain.prepare(spec);
     
+    filtersNeedUpdate = true;
     updateFilters();
     
-    leftChannelFifo.prepare(samplesPerBlock);
-    rightChannelFifo.prepare(samplesPerBlock);
+    autoGain.reset(sampleRate, 0.05);
+    autoGain.setCurrentAndTargetValue(autoGainTarget.load());
+    
+    morphPosition.reset(sampleRate, 0.05);
+    morphPosition.setCurrentAndTargetValue(apvts.getRawParameterValue("Preset Morph")->load());
+    rebuildMorphTable();
     
+    outputMeter.prepare(sampleRate, samplesPerBlock);
+    goniometerFeed.prepare(sampleRate);
 }
 
 void JhanEQAudioProcessor::releaseResources()
@@ -160,7 +192,14 @@ void JhanEQAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce:
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
     
-    updateFilters();
+    if( ! updateMorph(buffer.getNumSamples()) )
+        updateFilters();
+    
+    const auto analyzerTaps = enabledAnalyzerTaps.load();
+    
+    //the pre EQ taps are two more memcpy's, and only while an overlay is showing them
+    if( analyzerTaps & (PreLeftTap | PreRightTap) )
+        pushAnalyzerTaps(buffer, analyzerTaps, PreLeftTap, PreRightTap);
     
     juce::dsp::AudioBlock<float> block(buffer);
     
@@ -173,9 +212,169 @@ void JhanEQAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce:
     leftChain.process(leftContext);
     rightChain.process(rightContext);
     
-    leftChannelFifo.update(buffer);
-    rightChannelFifo.update(buffer);
+    //same rule as the other taps: both channels or nothing, so the positions stay together
+    if( (analyzerTaps & UncompensatedLeftTap) && buffer.getNumChannels() > Channel::Left )
+        getAnalyzerRing(UncompensatedLeftTap).push(buffer.getReadPointer(Channel::Left), buffer.getNumSamples());
+    
+    autoGain.setTargetValue(autoGainTarget.load());
+    
+    if( autoGain.isSmoothing() || autoGain.getCurrentValue() != 1.f )
+    {
+        auto startGain = autoGain.getCurrentValue();
+        autoGain.skip(buffer.getNumSamples());
+        buffer.applyGainRamp(0, buffer.getNumSamples(), startGain, autoGain.getCurrentValue());
+    }
+    
+    if( analyzerTaps & (PostLeftTap | PostRightTap) )
+        pushAnalyzerTaps(buffer, analyzerTaps, PostLeftTap, PostRightTap);
+    
+    if( metersEnabled.load() )
+        outputMeter.process(buffer.getArrayOfReadPointers(), buffer.getNumChannels(), buffer.getNumSamples(), outputLevels);
+    
+    //a mono bus shows up as a vertical line
+    if( goniometerEnabled.load() && buffer.getNumChannels() > 0 )
+        goniometerFeed.process(buffer.getReadPointer(0),
+                               buffer.getReadPointer(juce::jmin(1, buffer.getNumChannels() - 1)),
+                               buffer.getNumSamples());
+}
+
+void JhanEQAudioProcessor::attachMeters()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    if( ++numMeterClients > 1 )
+        return;
+    
+    //the meter's state belongs to the audio thread, so it's only touched while holding the callback lock
+    const juce::ScopedLock sl(getCallbackLock());
+    outputMeter.reset();
+    metersEnabled = true;
+}
+
+void JhanEQAudioProcessor::detachMeters()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    jassert( numMeterClients > 0 );
+    
+    if( --numMeterClients > 0 )
+        return;
+    
+    metersEnabled = false;
+}
+
+void JhanEQAudioProcessor::attachGoniometer()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    if( ++numGoniometerClients > 1 )
+        return;
+    
+    //still switched off, so the audio thread isn't touching the feed while it allocates
+    goniometerFeed.allocate();
+    goniometerEnabled = true;
+}
+
+void JhanEQAudioProcessor::detachGoniometer()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    jassert( numGoniometerClients > 0 );
+    
+    if( --numGoniometerClients > 0 )
+        return;
+    
+    {
+        const juce::ScopedLock sl(getCallbackLock());
+        goniometerEnabled = false;
+    }
     
+    goniometerFeed.release();
+}
+
+void JhanEQAudioProcessor::pushAnalyzerTaps(const juce::AudioBuffer<float>& buffer, int taps, AnalyzerTap leftTap, AnalyzerTap rightTap)
+{
+    //all the taps have to advance together, so it's both channels or nothing
+    if( buffer.getNumChannels() <= Channel::Left )
+        return;
+    
+    if( taps & leftTap )
+        getAnalyzerRing(leftTap).push(buffer.getReadPointer(Channel::Left), buffer.getNumSamples());
+    
+    if( taps & rightTap )
+        getAnalyzerRing(rightTap).push(buffer.getReadPointer(Channel::Right), buffer.getNumSamples());
+}
+
+SampleRing& JhanEQAudioProcessor::getAnalyzerRing(AnalyzerTap tap)
+{
+    jassert( juce::isPowerOfTwo((int)tap) );
+    return analyzerRings[(size_t)juce::findHighestSetBit((juce::uint32)tap)];
+}
+
+void JhanEQAudioProcessor::attachAnalyzer(int taps)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    int newTaps = 0;
+    
+    for( int i = 0; i < NumAnalyzerTaps; ++i )
+    {
+        if( (taps & (1 << i)) && ++numAnalyzerClients[(size_t)i] == 1 )
+        {
+            //the tap is still off, so the audio thread can't be touching the ring while it allocates
+            analyzerRings[(size_t)i].prepare(analyzerRingSize);
+            newTaps |= 1 << i;
+        }
+    }
+    
+    if( newTaps == 0 )
+        return;
+    
+    //every running tap is pushed in the same callback, so they all share a position.
+    //new taps start there too, which lets the analyzer read the same window out of each.
+    const juce::ScopedLock sl(getCallbackLock());
+    
+    const auto runningTaps = enabledAnalyzerTaps.load();
+    SampleRing::Position position = 0;
+    
+    for( int i = 0; i < NumAnalyzerTaps; ++i )
+        if( runningTaps & (1 << i) )
+            position = analyzerRings[(size_t)i].getWritePosition();
+    
+    for( int i = 0; i < NumAnalyzerTaps; ++i )
+        if( newTaps & (1 << i) )
+            analyzerRings[(size_t)i].setWritePosition(position);
+    
+    enabledAnalyzerTaps |= newTaps;
+}
+
+void JhanEQAudioProcessor::detachAnalyzer(int taps)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    
+    int unusedTaps = 0;
+    
+    for( int i = 0; i < NumAnalyzerTaps; ++i )
+    {
+        if( taps & (1 << i) )
+        {
+            jassert( numAnalyzerClients[(size_t)i] > 0 );
+            
+            if( --numAnalyzerClients[(size_t)i] == 0 )
+                unusedTaps |= 1 << i;
+        }
+    }
+    
+    if( unusedTaps == 0 )
+        return;
+    
+    {
+        //once we hold the callback lock, processBlock has either finished with the taps or will see them switched off
+        const juce::ScopedLock sl(getCallbackLock());
+        enabledAnalyzerTaps &= ~unusedTaps;
+    }
+    
+    for( int i = 0; i < NumAnalyzerTaps; ++i )
+        if( unusedTaps & (1 << i) )
+            analyzerRings[(size_t)i].release();
 }
 
 //==============================================================================
@@ -186,6 +385,9 @@ bool JhanEQAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* JhanEQAudioProcessor::createEditor()
 {
+    if( editorResources == nullptr )
+        editorResources = std::make_unique<juce::SharedResourcePointer<SharedEditorResources>>();
+    
     return new JhanEQAudioProcessorEditor (*this);
 //    return new juce::GenericAudioProcessorEditor(*this);
 }
@@ -197,21 +399,209 @@ void JhanEQAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
     
-    juce::MemoryOutputStream mos(destData, true);
-    apvts.state.writeToStream(mos);
+    //hosts may ask for this on every autosave tick, so only re-serialize after something changed
+    const juce::ScopedLock sl(stateLock);
+    
+    if( stateDirty.exchange(false) )
+        writeState(cachedState);
+    
+    destData = cachedState;
 }
 
 void JhanEQAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
-    auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
-    if( tree.isValid() )
+    const juce::ScopedLock sl(stateLock);
+    
+    //a session brings its own morph presets along with the band values
+    const juce::ScopedValueSetter<bool> svs(restoringState, true);
+    
+    switch( readState(data, sizeInBytes) )
     {
-        apvts.replaceState(tree);
-        updateFilters();
+        case StateResult::Current:
+            //what we just applied is exactly what we'd write back
+            cachedState.replaceWith(data, (size_t)sizeInBytes);
+            stateDirty = false;
+            break;
+            
+        case StateResult::Newer:
+            //written by a newer version: nothing was applied, so neither is the cache touched
+            return;
+            
+        case StateResult::Unrecognised:
+        {
+            auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
+            if( tree.isValid() )
+                readLegacyState(tree);
+            
+            stateDirty = true;
+            break;
+        }
     }
     
+    rebuildMorphTable();
+    updateFilters();
+}
+
+void JhanEQAudioProcessor::writeState(juce::MemoryBlock& destData)
+{
+    destData.reset();
+    juce::MemoryOutputStream mos(destData, false);
+    
+    mos.writeInt(stateMagic);
+    mos.writeInt(stateVersion);
+    
+    const auto& params = getParameters();
+    mos.writeInt(params.size());
+    
+    for( auto* param : params )
+    {
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(param);
+        jassert( ranged != nullptr );
+        
+        mos.writeString(ranged->paramID);
+        mos.writeFloat(ranged->convertFrom0to1(ranged->getValue()));
+    }
+    
+    juce::ValueTree extras("Extras");
+    for( const auto& child : apvts.state )
+    {
+        if( ! child.hasType("PARAM") )
+            extras.appendChild(child.createCopy(), nullptr);
+    }
+    
+    if( extras.getNumChildren() > 0 )
+    {
+        juce::MemoryOutputStream extrasStream;
+        extras.writeToStream(extrasStream);
+        
+        mos.writeInt((int)extrasStream.getDataSize());
+        mos.write(extrasStream.getData(), extrasStream.getDataSize());
+    }
+    else
+    {
+        mos.writeInt(0);
+    }
+}
+
+JhanEQAudioProcessor::StateResult JhanEQAudioProcessor::readState(const void* data, int sizeInBytes)
+{
+    juce::MemoryInputStream mis(data, (size_t)sizeInBytes, false);
+    
+    if( sizeInBytes < 12 || mis.readInt() != stateMagic )
+        return StateResult::Unrecognised;
+    
+    const auto version = mis.readInt();
+    
+    if( version > stateVersion )
+    {
+        //keep what we have rather than guessing
+        jassertfalse;
+        return StateResult::Newer;
+    }
+    
+    //there has only ever been the one binary format, sessions from before it are ValueTrees
+    if( version < stateVersion )
+        return StateResult::Unrecognised;
+    
+    auto numParams = mis.readInt();
+    
+    juce::StringArray readIDs;
+    
+    for( int i = 0; i < numParams && ! mis.isExhausted(); ++i )
+    {
+        auto* target = apvts.getParameter(mis.readString());
+        auto value = mis.readFloat();
+        
+        if( target != nullptr )
+        {
+            setParameterIfDifferent(*target, value);
+            readIDs.add(target->paramID);
+        }
+    }
+    
+    resetParametersExcept(readIDs);
+    
+    auto extrasSize = mis.isExhausted() ? 0 : mis.readInt();
+    if( extrasSize > 0 && extrasSize <= mis.getNumBytesRemaining() )
+    {
+        auto extras = juce::ValueTree::readFromData(static_cast<const char*>(data) + mis.getPosition(), (size_t)extrasSize);
+        if( extras.isValid() )
+            setExtrasIfDifferent(extras);
+    }
+    
+    return StateResult::Current;
+}
+
+void JhanEQAudioProcessor::readLegacyState(const juce::ValueTree& tree)
+{
+    if( ! tree.hasType(apvts.state.getType()) )
+        return;
+    
+    juce::ValueTree extras("Extras");
+    juce::StringArray readIDs;
+    
+    for( const auto& child : tree )
+    {
+        if( child.hasType("PARAM") )
+        {
+            if( auto* param = apvts.getParameter(child.getProperty("id").toString()) )
+            {
+                setParameterIfDifferent(*param, child.getProperty("value"));
+                readIDs.add(param->paramID);
+            }
+        }
+        else
+        {
+            extras.appendChild(child.createCopy(), nullptr);
+        }
+    }
+    
+    resetParametersExcept(readIDs);
+    setExtrasIfDifferent(extras);
+}
+
+void JhanEQAudioProcessor::resetParametersExcept(const juce::StringArray& paramIDs)
+{
+    //a session from before a parameter existed shouldn't inherit whatever it was set to last
+    for( auto* param : getParameters() )
+    {
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(param);
+        if( ranged != nullptr && ! paramIDs.contains(ranged->paramID) )
+            setParameterIfDifferent(*ranged, ranged->convertFrom0to1(ranged->getDefaultValue()));
+    }
+}
+
+bool JhanEQAudioProcessor::setParameterIfDifferent(juce::RangedAudioParameter& param, float newValue)
+{
+    auto normalised = param.convertTo0to1(newValue);
+    
+    if( normalised == param.getValue() )
+        return false;
+    
+    param.setValueNotifyingHost(normalised);
+    return true;
+}
+
+void JhanEQAudioProcessor::setExtrasIfDifferent(const juce::ValueTree& extras)
+{
+    for( int i = apvts.state.getNumChildren(); --i >= 0; )
+    {
+        auto child = apvts.state.getChild(i);
+        if( ! child.hasType("PARAM") && ! extras.getChildWithName(child.getType()).isValid() )
+            apvts.state.removeChild(i, nullptr);
+    }
+    
+    for( const auto& child : extras )
+    {
+        auto existing = apvts.state.getChildWithName(child.getType());
+        
+        if( ! existing.isValid() )
+            apvts.state.appendChild(child.createCopy(), nullptr);
+        else if( ! existing.isEquivalentTo(child) )
+            existing.copyPropertiesAndChildrenFrom(child, nullptr);
+    }
 }
 
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
@@ -229,6 +619,27 @@ ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
     return settings;
 }
 
+void setChainSettings(juce::AudioProcessorValueTreeState& apvts, const ChainSettings& chainSettings)
+{
+    auto set = [&apvts](const juce::String& parameterID, float value)
+    {
+        if( auto* param = apvts.getParameter(parameterID) )
+        {
+            param->beginChangeGesture();
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+            param->endChangeGesture();
+        }
+    };
+    
+    set("HighPass Freq", chainSettings.highPassFreq);
+    set("LowPass Freq", chainSettings.lowPassFreq);
+    set("Peak Freq", chainSettings.peakFreq);
+    set("Peak Gain", chainSettings.peakGainDecibels);
+    set("Peak Quality", chainSettings.peakQuality);
+    set("HighPass Slope", float(chainSettings.highPassSlope));
+    set("LowPass Slope", float(chainSettings.lowPassSlope));
+}
+
 Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate)
 {
     return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate,
@@ -238,50 +649,452 @@ Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRat
 }
 
 
-void JhanEQAudioProcessor::updatePeakFilter(const ChainSettings &chainSettings)
+void updateCoefficients(Coefficients &old, const Coefficients &replacements)
 {
-   
-    auto peakCoefficients = makePeakFilter(chainSettings, getSampleRate());
-       
-    updateCoefficients(leftChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
-    updateCoefficients(rightChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
+    *old = *replacements;
+}
 
+static BiquadCoefficients makeBiquad(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    auto a0Inverse = 1.0 / a0;
+    
+    return { float(b0 * a0Inverse), float(b1 * a0Inverse), float(b2 * a0Inverse),
+             float(a1 * a0Inverse), float(a2 * a0Inverse) };
 }
 
-void updateCoefficients(Coefficients &old, const Coefficients &replacements)
+static void designPassFilter(std::array<BiquadCoefficients, 4>& sections,
+                             double freq,
+                             double sampleRate,
+                             Slope slope,
+                             bool isHighPass)
 {
-    *old = *replacements;
+    using namespace juce;
+    
+    //same sections as FilterDesign::designIIR*HighOrderButterworthMethod for an even order
+    const auto order = 2 * (slope + 1);
+    
+    for( int i = 0; i < 4; ++i )
+    {
+        if( i >= order / 2 )
+        {
+            sections[i] = { 1.f, 0.f, 0.f, 0.f, 0.f };
+            continue;
+        }
+        
+        auto q = 1.0 / (2.0 * std::cos((2.0 * i + 1.0) * MathConstants<double>::pi / (order * 2.0)));
+        auto invQ = 1.0 / q;
+        
+        auto n = std::tan(MathConstants<double>::pi * freq / sampleRate);
+        if( ! isHighPass )
+            n = 1.0 / n;
+        
+        auto nSquared = n * n;
+        auto c1 = 1.0 / (1.0 + invQ * n + nSquared);
+        
+        if( isHighPass )
+            sections[i] = makeBiquad(c1, c1 * -2.0, c1, 1.0, c1 * 2.0 * (nSquared - 1.0), c1 * (1.0 - invQ * n + nSquared));
+        else
+            sections[i] = makeBiquad(c1, c1 * 2.0, c1, 1.0, c1 * 2.0 * (1.0 - nSquared), c1 * (1.0 - invQ * n + nSquared));
+    }
+}
+
+ChainCoefficients makeChainCoefficients(const ChainSettings& chainSettings, double sampleRate)
+{
+    using namespace juce;
+    
+    ChainCoefficients chainCoefficients;
+    
+    //same design as IIR::Coefficients::makePeakFilter
+    auto A = std::sqrt(Decibels::decibelsToGain((double)chainSettings.peakGainDecibels));
+    auto omega = (MathConstants<double>::twoPi * jmax((double)chainSettings.peakFreq, 2.0)) / sampleRate;
+    auto alpha = std::sin(omega) / (chainSettings.peakQuality * 2.0);
+    auto c2 = -2.0 * std::cos(omega);
+    
+    chainCoefficients.peak = makeBiquad(1.0 + alpha * A, c2, 1.0 - alpha * A, 1.0 + alpha / A, c2, 1.0 - alpha / A);
+    
+    designPassFilter(chainCoefficients.highPass, chainSettings.highPassFreq, sampleRate, chainSettings.highPassSlope, true);
+    designPassFilter(chainCoefficients.lowPass, chainSettings.lowPassFreq, sampleRate, chainSettings.lowPassSlope, false);
+    
+    chainCoefficients.highPassSlope = chainSettings.highPassSlope;
+    chainCoefficients.lowPassSlope = chainSettings.lowPassSlope;
+    
+    return chainCoefficients;
+}
+
+static void applyBiquad(Filter& filter, const BiquadCoefficients& biquad)
+{
+    auto& raw = filter.coefficients->coefficients;
+    raw.resize((int)biquad.size());
+    std::copy(biquad.begin(), biquad.end(), raw.begin());
+}
+
+static void applyPassFilter(PassFilter& chain, const std::array<BiquadCoefficients, 4>& sections, Slope slope)
+{
+    applyBiquad(chain.get<0>(), sections[0]);
+    applyBiquad(chain.get<1>(), sections[1]);
+    applyBiquad(chain.get<2>(), sections[2]);
+    applyBiquad(chain.get<3>(), sections[3]);
+    
+    chain.setBypassed<0>(false);
+    chain.setBypassed<1>(slope < Slope_24);
+    chain.setBypassed<2>(slope < Slope_36);
+    chain.setBypassed<3>(slope < Slope_48);
+}
+
+void applyChainCoefficients(MonoChain& chain, const ChainCoefficients& chainCoefficients)
+{
+    applyBiquad(chain.get<ChainPositions::Peak>(), chainCoefficients.peak);
+    applyPassFilter(chain.get<ChainPositions::HighPass>(), chainCoefficients.highPass, chainCoefficients.highPassSlope);
+    applyPassFilter(chain.get<ChainPositions::LowPass>(), chainCoefficients.lowPass, chainCoefficients.lowPassSlope);
+}
+
+void prepareCoefficientStorage(MonoChain& chain)
+{
+    //an identity biquad everywhere, so every section is second order before prepare() sizes its state
+    const BiquadCoefficients identity { 1.f, 0.f, 0.f, 0.f, 0.f };
+    
+    applyBiquad(chain.get<ChainPositions::Peak>(), identity);
+    
+    for( auto* passFilter : { &chain.get<ChainPositions::HighPass>(), &chain.get<ChainPositions::LowPass>() } )
+    {
+        applyBiquad(passFilter->get<0>(), identity);
+        applyBiquad(passFilter->get<1>(), identity);
+        applyBiquad(passFilter->get<2>(), identity);
+        applyBiquad(passFilter->get<3>(), identity);
+    }
 }
 
-void JhanEQAudioProcessor::updateHighPassFilters(const ChainSettings &chainSettings)
+ChainCoefficients interpolateChainCoefficients(const ChainCoefficients& a, const ChainCoefficients& b, float amount)
 {
-    auto highPassCoefficients = makeHighPassFilter(chainSettings, getSampleRate());
-       
-       auto& leftHighPass = leftChain.get<ChainPositions::HighPass>();
-       auto& rightHighPass = rightChain.get<ChainPositions::HighPass>();
+    auto blend = [amount](const BiquadCoefficients& x, const BiquadCoefficients& y)
+    {
+        BiquadCoefficients result;
+        for( size_t i = 0; i < result.size(); ++i )
+            result[i] = x[i] + amount * (y[i] - x[i]);
+        return result;
+    };
+    
+    ChainCoefficients result;
+    
+    result.peak = blend(a.peak, b.peak);
+    for( size_t i = 0; i < result.highPass.size(); ++i )
+    {
+        result.highPass[i] = blend(a.highPass[i], b.highPass[i]);
+        result.lowPass[i] = blend(a.lowPass[i], b.lowPass[i]);
+    }
+    
+    //unused sections are identity biquads, so extra sections fade in rather than switching on
+    result.highPassSlope = juce::jmax(a.highPassSlope, b.highPassSlope);
+    result.lowPassSlope = juce::jmax(a.lowPassSlope, b.lowPassSlope);
     
-       updatePassFilter(rightHighPass, highPassCoefficients, chainSettings.highPassSlope);
-       updatePassFilter(leftHighPass, highPassCoefficients, chainSettings.highPassSlope);
+    return result;
 }
 
-void JhanEQAudioProcessor::updateLowPassFilters(const ChainSettings &chainSettings)
+ChainSettings interpolateChainSettings(const ChainSettings& a, const ChainSettings& b, float amount)
 {
-    auto lowPassCoefficients = makeLowPassFilter(chainSettings, getSampleRate());
+    //frequencies and Q move geometrically, so the morph sounds even across the range
+    auto geometric = [amount](float x, float y)
+    {
+        return x * std::pow(y / x, amount);
+    };
+    
+    ChainSettings result;
     
-    auto& leftLowPass = leftChain.get<ChainPositions::LowPass>();
-    auto& rightLowPass = rightChain.get<ChainPositions::LowPass>();
+    result.peakFreq = geometric(a.peakFreq, b.peakFreq);
+    result.peakGainDecibels = a.peakGainDecibels + amount * (b.peakGainDecibels - a.peakGainDecibels);
+    result.peakQuality = geometric(a.peakQuality, b.peakQuality);
+    result.highPassFreq = geometric(a.highPassFreq, b.highPassFreq);
+    result.lowPassFreq = geometric(a.lowPassFreq, b.lowPassFreq);
+    result.highPassSlope = amount < 0.5f ? a.highPassSlope : b.highPassSlope;
+    result.lowPassSlope = amount < 0.5f ? a.lowPassSlope : b.lowPassSlope;
     
-    updatePassFilter(leftLowPass, lowPassCoefficients, chainSettings.lowPassSlope);
-    updatePassFilter(rightLowPass, lowPassCoefficients, chainSettings.lowPassSlope);
+    return result;
 }
 
 void JhanEQAudioProcessor::updateFilters()
 {
+    //nothing to design against until prepareToPlay, which forces an update anyway
+    if( getSampleRate() <= 0 )
+        return;
+    
     auto chainSettings = getChainSettings(apvts);
     
-    updateHighPassFilters(chainSettings);
-    updatePeakFilter(chainSettings);
-    updateLowPassFilters(chainSettings);
+    const bool chainChanged = filtersNeedUpdate || chainSettings != lastChainSettings;
+    
+    if( chainChanged )
+    {
+        auto chainCoefficients = makeChainCoefficients(chainSettings, getSampleRate());
+        
+        applyChainCoefficients(leftChain, chainCoefficients);
+        applyChainCoefficients(rightChain, chainCoefficients);
+        publishChain(chainCoefficients);
+        
+        lastChainSettings = chainSettings;
+        filtersNeedUpdate = false;
+    }
+    
+    updateAutoGain(chainChanged);
+}
+
+void JhanEQAudioProcessor::publishChain(const ChainCoefficients& chainCoefficients)
+{
+    //a morph re-applies the same coefficients every block while its position sits still.
+    //ChainCoefficients is nothing but 4 byte fields, so there's no padding to compare
+    if( getSampleRate() == lastPublishedSampleRate
+       && std::memcmp(&chainCoefficients, &lastPublishedCoefficients, sizeof(ChainCoefficients)) == 0 )
+        return;
+    
+    lastPublishedCoefficients = chainCoefficients;
+    lastPublishedSampleRate = getSampleRate();
+    
+    chainSnapshot.publish({ chainCoefficients, lastPublishedSampleRate });
+}
+
+void JhanEQAudioProcessor::updateAutoGain(bool chainChanged)
+{
+    auto enabled = apvts.getRawParameterValue("Auto Gain")->load() > 0.5f;
+    auto reference = static_cast<AutoGainReference>(apvts.getRawParameterValue("Auto Gain Reference")->load());
+    
+    if( ! chainChanged && enabled == lastAutoGainEnabled && reference == lastAutoGainReference )
+        return;
+    
+    lastAutoGainEnabled = enabled;
+    lastAutoGainReference = reference;
+    
+    autoGainTarget = enabled ? getAutoGainForChain(leftChain, getSampleRate(), reference) : 1.f;
+}
+
+//==============================================================================
+PresetLibrary& JhanEQAudioProcessor::getPresetLibrary()
+{
+    return *presetLibrary;
+}
+
+void JhanEQAudioProcessor::loadPreset(int index)
+{
+    if( ! juce::isPositiveAndBelow(index, presetLibrary->getNumPresets()) )
+        return;
+    
+    currentProgram = index;
+    
+    if( morphing )
+        clearMorphPresets();
+    
+    //the audio thread picks the new values up in updateFilters() and redesigns without allocating
+    setChainSettings(apvts, presetLibrary->getSettings(index));
+}
+
+static juce::ValueTree makeMorphSide(const juce::Identifier& side, const juce::String& name, const ChainSettings& settings)
+{
+    juce::ValueTree tree(side);
+    tree.setProperty("name", name, nullptr);
+    tree.setProperty("peakFreq", settings.peakFreq, nullptr);
+    tree.setProperty("peakGainDecibels", settings.peakGainDecibels, nullptr);
+    tree.setProperty("peakQuality", settings.peakQuality, nullptr);
+    tree.setProperty("highPassFreq", settings.highPassFreq, nullptr);
+    tree.setProperty("lowPassFreq", settings.lowPassFreq, nullptr);
+    tree.setProperty("highPassSlope", (int)settings.highPassSlope, nullptr);
+    tree.setProperty("lowPassSlope", (int)settings.lowPassSlope, nullptr);
+    return tree;
+}
+
+static ChainSettings getMorphSideSettings(const juce::ValueTree& tree)
+{
+    ChainSettings settings;
+    settings.peakFreq = tree.getProperty("peakFreq");
+    settings.peakGainDecibels = tree.getProperty("peakGainDecibels");
+    settings.peakQuality = tree.getProperty("peakQuality", 1.f);
+    settings.highPassFreq = tree.getProperty("highPassFreq");
+    settings.lowPassFreq = tree.getProperty("lowPassFreq");
+    settings.highPassSlope = static_cast<Slope>(juce::jlimit<int>(Slope_12, Slope_48, tree.getProperty("highPassSlope")));
+    settings.lowPassSlope = static_cast<Slope>(juce::jlimit<int>(Slope_12, Slope_48, tree.getProperty("lowPassSlope")));
+    return settings;
+}
+
+void JhanEQAudioProcessor::setMorphPreset(bool presetB, int index)
+{
+    const juce::Identifier side(presetB ? "B" : "A");
+    
+    auto morph = apvts.state.getOrCreateChildWithName("Morph", nullptr);
+    morph.removeChild(morph.getChildWithName(side), nullptr);
+    
+    if( juce::isPositiveAndBelow(index, presetLibrary->getNumPresets()) )
+        morph.appendChild(makeMorphSide(side, presetLibrary->getName(index), presetLibrary->getSettings(index)), nullptr);
+    
+    //whatever moved before this doesn't end the new morph
+    leaveMorphRequested = false;
+    rebuildMorphTable();
+}
+
+void JhanEQAudioProcessor::clearMorphPresets()
+{
+    auto morph = apvts.state.getChildWithName("Morph");
+    morph.removeAllChildren(nullptr);
+    morph.removeAllProperties(nullptr);
+    
+    rebuildMorphTable();
+}
+
+juce::String JhanEQAudioProcessor::getMorphPresetName(bool presetB) const
+{
+    return apvts.state.getChildWithName("Morph").getChildWithName(presetB ? "B" : "A").getProperty("name").toString();
+}
+
+bool JhanEQAudioProcessor::hasMorphPresets() const
+{
+    auto morph = apvts.state.getChildWithName("Morph");
+    return morph.getChildWithName("A").isValid() && morph.getChildWithName("B").isValid();
+}
+
+void JhanEQAudioProcessor::rebuildMorphTable()
+{
+    std::unique_ptr<MorphTable> newTable;
+    
+    auto morph = apvts.state.getChildWithName("Morph");
+    auto sampleRate = getSampleRate();
+    
+    if( hasMorphPresets() && sampleRate > 0 )
+    {
+        newTable = std::make_unique<MorphTable>();
+        
+        auto settingsA = getMorphSideSettings(morph.getChildWithName("A"));
+        auto settingsB = getMorphSideSettings(morph.getChildWithName("B"));
+        
+        MonoChain chain;
+        prepareCoefficientStorage(chain);
+        
+        for( int i = 0; i < MorphTable::NumSteps; ++i )
+        {
+            auto amount = float(i) / float(MorphTable::NumSteps - 1);
+            auto coefficients = makeChainCoefficients(interpolateChainSettings(settingsA, settingsB, amount), sampleRate);
+            
+            newTable->coefficients[i] = coefficients;
+            
+            applyChainCoefficients(chain, coefficients);
+            newTable->pinkGains[i] = getAutoGainForChain(chain, sampleRate, AutoGainReference::Pink);
+            newTable->speechGains[i] = getAutoGainForChain(chain, sampleRate, AutoGainReference::Speech);
+        }
+    }
+    
+    {
+        const juce::ScopedLock sl(getCallbackLock());
+        std::swap(morphTable, newTable);
+        morphing = morphTable != nullptr;
+        
+        //when morphing stops the parameters take over again
+        filtersNeedUpdate = true;
+    }
+}
+
+void JhanEQAudioProcessor::parameterValueChanged(int parameterIndex, float newValue)
+{
+    stateDirty = true;
+    
+    //may be the audio thread, so all it does is leave a note for the timer
+    if( morphing && ! restoringState && bandParameterIndices.contains(parameterIndex) )
+        leaveMorphRequested = true;
+}
+
+void JhanEQAudioProcessor::timerCallback()
+{
+    if( leaveMorphRequested.exchange(false) && morphing )
+        clearMorphPresets();
+}
+
+bool JhanEQAudioProcessor::updateMorph(int numSamples)
+{
+    if( morphTable == nullptr )
+        return false;
+    
+    morphPosition.setTargetValue(apvts.getRawParameterValue("Preset Morph")->load());
+    auto position = juce::jlimit(0.f, 1.f, morphPosition.skip(numSamples));
+    
+    auto scaled = position * float(MorphTable::NumSteps - 1);
+    auto index = juce::jmin((int)scaled, MorphTable::NumSteps - 2);
+    auto amount = scaled - float(index);
+    
+    auto chainCoefficients = interpolateChainCoefficients(morphTable->coefficients[index],
+                                                          morphTable->coefficients[index + 1],
+                                                          amount);
+    
+    applyChainCoefficients(leftChain, chainCoefficients);
+    applyChainCoefficients(rightChain, chainCoefficients);
+    publishChain(chainCoefficients);
+    
+    auto autoGainEnabled = apvts.getRawParameterValue("Auto Gain")->load() > 0.5f;
+    auto reference = static_cast<AutoGainReference>(apvts.getRawParameterValue("Auto Gain Reference")->load());
+    const auto& gains = reference == AutoGainReference::Pink ? morphTable->pinkGains : morphTable->speechGains;
+    
+    autoGainTarget = autoGainEnabled ? gains[index] + amount * (gains[index + 1] - gains[index]) : 1.f;
+    
+    return true;
+}
+
+double getChainMagnitudeForFrequency(const MonoChain& chain, double freq, double sampleRate)
+{
+    auto& highPass = chain.get<ChainPositions::HighPass>();
+    auto& peak = chain.get<ChainPositions::Peak>();
+    auto& lowPass = chain.get<ChainPositions::LowPass>();
+    
+    double mag = 1.f;
+    
+    if(! chain.isBypassed<ChainPositions::Peak>() )
+        mag *= peak.coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    
+    if( !highPass.isBypassed<0>() )
+        mag *= highPass.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    if( !highPass.isBypassed<1>() )
+        mag *= highPass.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    if( !highPass.isBypassed<2>() )
+        mag *= highPass.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    if( !highPass.isBypassed<3>() )
+        mag *= highPass.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    
+    if( !lowPass.isBypassed<0>() )
+        mag *= lowPass.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    if( !lowPass.isBypassed<1>() )
+        mag *= lowPass.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    if( !lowPass.isBypassed<2>() )
+        mag *= lowPass.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    if( !lowPass.isBypassed<3>() )
+        mag *= lowPass.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    
+    return mag;
+}
+
+float getAutoGainForChain(const MonoChain& chain, double sampleRate, AutoGainReference reference)
+{
+    /*
+     pink noise has equal power per octave, so on a log spaced grid every point weighs the same.
+     the speech reference tilts that towards a long term speech spectrum:
+     rolled off below ~125Hz and falling 6dB/oct above ~500Hz.
+     */
+    constexpr int numPoints = 64;
+    
+    double weightedPower = 0, weightSum = 0;
+    
+    for( int i = 0; i < numPoints; ++i )
+    {
+        auto freq = juce::mapToLog10(double(i) / double(numPoints - 1), 20.0, 20000.0);
+        
+        double weight = 1.0;
+        if( reference == AutoGainReference::Speech )
+        {
+            auto lowRatio = juce::square(freq / 125.0);
+            auto highRatio = juce::square(freq / 500.0);
+            weight = (juce::square(lowRatio) / (1.0 + juce::square(lowRatio))) / (1.0 + highRatio);
+        }
+        
+        auto mag = getChainMagnitudeForFrequency(chain, freq, sampleRate);
+        weightedPower += weight * mag * mag;
+        weightSum += weight;
+    }
+    
+    if( weightedPower <= 0.0 )
+        return 1.f;
+    
+    auto gain = std::sqrt(weightSum / weightedPower);
+    return (float)juce::jlimit(juce::Decibels::decibelsToGain(-24.0), juce::Decibels::decibelsToGain(24.0), gain);
 }
 
 
@@ -326,6 +1139,17 @@ juce::AudioProcessorValueTreeState::ParameterLayout JhanEQAudioProcessor::create
     layout.add(std::make_unique<juce::AudioParameterChoice>("HighPass Slope", "HighPass Slope", stringArray, 0));
     layout.add(std::make_unique<juce::AudioParameterChoice>("LowPass Slope", "LowPass Slope", stringArray, 0));
     
+    layout.add(std::make_unique<juce::AudioParameterBool>("Auto Gain", "Auto Gain", false));
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Auto Gain Reference",
+                                                            "Auto Gain Reference",
+                                                            juce::StringArray { "Pink", "Speech" },
+                                                            0));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Preset Morph",
+                                                           "Preset Morph",
+                                                           juce::NormalisableRange<float>(0.f, 1.f, 0.001f, 1.f),
+                                                           0.f));
+    
     
     return layout;
 }
@@ -9,11 +9,24 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SampleRing.h"
+#include "LevelMeter.h"
+#include "Goniometer.h"
+#include "VersionedSnapshot.h"
 
 #include <array>
-template<typename T>
+/*
+ single producer / single consumer queue of preallocated slots.
+ push and pull swap the caller's object with a slot instead of copying it, so once
+ both sides hold objects of the right size nothing is allocated or deep copied.
+ */
+template<typename T, int Capacity>
 struct Fifo
 {
+    static_assert( Capacity > 0, "a Fifo needs at least one slot");
+    
+    Fifo() = default;
+    
     void prepare(int numChannels, int numSamples)
     {
         static_assert( std::is_same_v<T, juce::AudioBuffer<float>>,
@@ -40,24 +53,39 @@ struct Fifo
         }
     }
     
-    bool push(const T& t)
+    /*
+     any other T: every slot starts out as a copy of 'prototype'.
+     */
+    void prepare(const T& prototype)
+    {
+        for( auto& buffer : buffers )
+            buffer = prototype;
+    }
+    
+    /*
+     on success 't' comes back holding whatever the slot held before, ready to be refilled.
+     */
+    bool push(T& t)
     {
         auto write = fifo.write(1);
         if( write.blockSize1 > 0 )
         {
-            buffers[write.startIndex1] = t;
+            std::swap(buffers[write.startIndex1], t);
             return true;
         }
         
         return false;
     }
     
+    /*
+     on success the slot keeps the object 't' held before, so hand in one of the same size.
+     */
     bool pull(T& t)
     {
         auto read = fifo.read(1);
         if( read.blockSize1 > 0 )
         {
-            t = buffers[read.startIndex1];
+            std::swap(buffers[read.startIndex1], t);
             return true;
         }
         
@@ -68,10 +96,23 @@ struct Fifo
     {
         return fifo.getNumReady();
     }
+    
+    /*
+     frees whatever the slots are holding. only call this while nothing is pushing or pulling.
+     */
+    void release()
+    {
+        for( auto& buffer : buffers )
+            buffer = T();
+        
+        fifo.reset();
+    }
 private:
-    static constexpr int Capacity = 30;
-    std::array<T, Capacity> buffers;
-    juce::AbstractFifo fifo {Capacity};
+    //AbstractFifo keeps one slot empty to tell full from empty
+    std::array<T, Capacity + 1> buffers;
+    juce::AbstractFifo fifo {Capacity + 1};
+    
+    JUCE_DECLARE_NON_COPYABLE(Fifo)
 };
 
 
@@ -81,70 +122,22 @@ enum Channel
     Left // effectively 1
 };
 
-template<typename BlockType>
-struct SingleChannelSampleFifo
+/*
+ the points the analyzer can listen to, as bit flags. the post taps are what's heard, after
+ auto gain. the uncompensated tap is the left channel between the EQ and auto gain, so a
+ measurement of the EQ doesn't include the compensation.
+ */
+enum AnalyzerTap
 {
-    SingleChannelSampleFifo(Channel ch) : channelToUse(ch)
-    {
-        prepared.set(false);
-    }
-    
-    void update(const BlockType& buffer)
-    {
-        jassert(prepared.get());
-        jassert(buffer.getNumChannels() > channelToUse );
-        auto* channelPtr = buffer.getReadPointer(channelToUse);
-        
-        for( int i = 0; i < buffer.getNumSamples(); ++i )
-        {
-            pushNextSampleIntoFifo(channelPtr[i]);
-        }
-    }
-
-    void prepare(int bufferSize)
-    {
-        prepared.set(false);
-        size.set(bufferSize);
-        
-        bufferToFill.setSize(1,             //channel
-                             bufferSize,    //num samples
-                             false,         //keepExistingContent
-                             true,          //clear extra space
-                             true);         //avoid reallocating
-        audioBufferFifo.prepare(1, bufferSize);
-        fifoIndex = 0;
-        prepared.set(true);
-    }
-    //==============================================================================
-    int getNumCompleteBuffersAvailable() const { return audioBufferFifo.getNumAvailableForReading(); }
-    bool isPrepared() const { return prepared.get(); }
-    int getSize() const { return size.get(); }
-    //==============================================================================
-    bool getAudioBuffer(BlockType& buf) { return audioBufferFifo.pull(buf); }
-private:
-    Channel channelToUse;
-    int fifoIndex = 0;
-    Fifo<BlockType> audioBufferFifo;
-    BlockType bufferToFill;
-    juce::Atomic<bool> prepared = false;
-    juce::Atomic<int> size = 0;
-    
-    void pushNextSampleIntoFifo(float sample)
-    {
-        if (fifoIndex == bufferToFill.getNumSamples())
-        {
-            auto ok = audioBufferFifo.push(bufferToFill);
-
-            juce::ignoreUnused(ok);
-            
-            fifoIndex = 0;
-        }
-        
-        bufferToFill.setSample(0, fifoIndex, sample);
-        ++fifoIndex;
-    }
+    PostLeftTap = 1 << 0,
+    PostRightTap = 1 << 1,
+    PreLeftTap = 1 << 2,
+    PreRightTap = 1 << 3,
+    UncompensatedLeftTap = 1 << 4
 };
 
+constexpr int NumAnalyzerTaps = 5;
+
 enum Slope
 {
     Slope_12,
@@ -160,9 +153,23 @@ struct ChainSettings
     float highPassFreq { 0 }, lowPassFreq { 0 };
     
     Slope highPassSlope { Slope::Slope_12 }, lowPassSlope { Slope::Slope_12 };
+    
+    bool operator==(const ChainSettings& other) const
+    {
+        return peakFreq == other.peakFreq
+            && peakGainDecibels == other.peakGainDecibels
+            && peakQuality == other.peakQuality
+            && highPassFreq == other.highPassFreq
+            && lowPassFreq == other.lowPassFreq
+            && highPassSlope == other.highPassSlope
+            && lowPassSlope == other.lowPassSlope;
+    }
+    
+    bool operator!=(const ChainSettings& other) const { return ! (*this == other); }
 };
 
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts);
+void setChainSettings(juce::AudioProcessorValueTreeState& apvts, const ChainSettings& chainSettings);
 
 using Filter = juce::dsp::IIR::Filter<float>;
 
@@ -177,6 +184,23 @@ enum ChainPositions
        LowPass
    };
 
+/*
+ the magnitude of every active section multiplied together.
+ this is what the response curve draws and what auto gain compensates for.
+ */
+double getChainMagnitudeForFrequency(const MonoChain& chain, double freq, double sampleRate);
+
+enum AutoGainReference
+{
+    Pink,
+    Speech
+};
+
+/*
+ the gain that brings the chain's power back to unity for the reference spectrum.
+ */
+float getAutoGainForChain(const MonoChain& chain, double sampleRate, AutoGainReference reference);
+
 using Coefficients = Filter::CoefficientsPtr;
 void updateCoefficients(Coefficients& old, const Coefficients& replacements);
 
@@ -235,10 +259,68 @@ inline auto makeLowPassFilter(const ChainSettings& chainSettings, double sampleR
                                                                                       2 * (chainSettings.lowPassSlope + 1));
 }
 
+/*
+ raw biquad coefficients, in the layout juce::dsp::IIR::Coefficients keeps them:
+ b0, b1, b2, a1, a2, already divided by a0.
+ */
+using BiquadCoefficients = std::array<float, 5>;
+
+struct ChainCoefficients
+{
+    std::array<BiquadCoefficients, 4> highPass, lowPass;
+    BiquadCoefficients peak;
+    
+    Slope highPassSlope { Slope::Slope_12 }, lowPassSlope { Slope::Slope_12 };
+};
+
+/*
+ the same designs as makePeakFilter / makeHighPassFilter / makeLowPassFilter,
+ written straight into a ChainCoefficients so they are safe to run on the audio thread.
+ */
+ChainCoefficients makeChainCoefficients(const ChainSettings& chainSettings, double sampleRate);
+
+/*
+ copies the coefficients into the chain's existing Coefficients objects and sets the bypass flags.
+ call prepareCoefficientStorage() once beforehand and this never allocates.
+ */
+void applyChainCoefficients(MonoChain& chain, const ChainCoefficients& chainCoefficients);
+void prepareCoefficientStorage(MonoChain& chain);
+
+/*
+ what the audio thread is running: the coefficients (the slopes say which pass
+ sections are switched on, the peak always is) and the rate they were designed for.
+ */
+struct ChainSnapshot
+{
+    ChainCoefficients coefficients;
+    double sampleRate = 0.0;
+};
+
+ChainCoefficients interpolateChainCoefficients(const ChainCoefficients& a, const ChainCoefficients& b, float amount);
+ChainSettings interpolateChainSettings(const ChainSettings& a, const ChainSettings& b, float amount);
+
+/*
+ coefficient sets precomputed across the A/B morph, designed on the message thread.
+ the audio thread only blends neighbouring entries.
+ */
+struct MorphTable
+{
+    static constexpr int NumSteps = 65;
+    
+    std::array<ChainCoefficients, NumSteps> coefficients;
+    std::array<float, NumSteps> pinkGains, speechGains;
+};
+
+struct PresetLibrary;
+struct SharedEditorResources;
+
 //==============================================================================
 /**
 */
-class JhanEQAudioProcessor  : public juce::AudioProcessor
+class JhanEQAudioProcessor  : public juce::AudioProcessor,
+                              private juce::AudioProcessorParameter::Listener,
+                              private juce::ValueTree::Listener,
+                              private juce::Timer
 {
 public:
     //==============================================================================
@@ -278,25 +360,162 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
+    //==============================================================================
+    PresetLibrary& getPresetLibrary();
+    void loadPreset(int index);
+    
+    /*
+     morphs between two presets with the "Preset Morph" parameter. each side keeps a copy of
+     the preset's name and settings, so a session recalls the same morph whatever happens
+     to the library afterwards. an index of -1 empties that side, which stops the morph.
+     loading a preset or touching a band parameter stops it as well, since the morph
+     replaces whatever the band parameters say.
+     */
+    void setMorphPreset(bool presetB, int index);
+    void clearMorphPresets();
+    juce::String getMorphPresetName(bool presetB) const;
+    bool hasMorphPresets() const;
+    
     static juce::AudioProcessorValueTreeState::ParameterLayout createrParemterLayout();
     juce::AudioProcessorValueTreeState apvts{*this, nullptr, "Parameters", createrParemterLayout()};
 
     using BlockType = juce::AudioBuffer<float>;
-    SingleChannelSampleFifo<BlockType> leftChannelFifo { Channel::Left };
-    SingleChannelSampleFifo<BlockType> rightChannelFifo { Channel::Right };
     
+    //big enough to hold the largest FFT window plus a few timer ticks of audio at any sample rate we run at
+    static constexpr int analyzerRingSize = 1 << 16;
+    
+    SampleRing& getAnalyzerRing(AnalyzerTap tap);
+    
+    /*
+     each analyzer tap costs nothing until something attaches to it. 'taps' is a set of AnalyzerTap flags.
+     both are message thread only: a tap's ring is allocated on its first attach and freed on its last detach.
+     */
+    void attachAnalyzer(int taps);
+    void detachAnalyzer(int taps);
+    
+    /*
+     the output meters only run while something is attached. message thread only.
+     */
+    void attachMeters();
+    void detachMeters();
+    LevelMeterValues& getOutputLevels() { return outputLevels; }
+    
+    /*
+     the goniometer's points are only produced while something is attached. message thread only.
+     */
+    void attachGoniometer();
+    void detachGoniometer();
+    GoniometerFeed& getGoniometerFeed() { return goniometerFeed; }
+    
+    /*
+     the coefficient set processBlock last switched to. republished whenever it changes,
+     including while a morph moves, so readers see exactly what's being heard.
+     */
+    const VersionedSnapshot<ChainSnapshot>& getChainSnapshot() const { return chainSnapshot; }
+    
+    /*
+     updateFilters on its own, so the benchmarks can time it apart from the rest of
+     processBlock. only from the thread that would otherwise call processBlock.
+     */
+    void updateFiltersForBenchmark() { updateFilters(); }
 
 private:
     
     MonoChain leftChain, rightChain;
     
-    void updatePeakFilter(const ChainSettings& chainSettings);
-  
-    void updateHighPassFilters(const ChainSettings& chainSettings);
-    void updateLowPassFilters(const ChainSettings& chainSettings);
+    /*
+     compact binary state:
+     magic, version, numParams, then (parameter ID, value) pairs,
+     then the size and ValueTree data of any non-parameter children of apvts.state.
+     anything that doesn't start with the magic is read as a legacy ValueTree session.
+     parameters a session doesn't mention go back to their defaults.
+     */
+    static constexpr int stateMagic = 0x5145684a; // "JhEQ"
+    static constexpr int stateVersion = 2;
+    
+    juce::CriticalSection stateLock;
+    juce::MemoryBlock cachedState;
+    std::atomic<bool> stateDirty { true };
+    
+    enum class StateResult
+    {
+        Current,
+        Newer,
+        Unrecognised
+    };
+    
+    void writeState(juce::MemoryBlock& destData);
+    StateResult readState(const void* data, int sizeInBytes);
+    void readLegacyState(const juce::ValueTree& tree);
+    
+    bool setParameterIfDifferent(juce::RangedAudioParameter& param, float newValue);
+    void resetParametersExcept(const juce::StringArray& paramIDs);
+    void setExtrasIfDifferent(const juce::ValueTree& extras);
+    
+    void parameterValueChanged (int parameterIndex, float newValue) override;
+    void parameterGestureChanged (int parameterIndex, bool gestureIsStarting) override { }
+    
+    void valueTreePropertyChanged (juce::ValueTree&, const juce::Identifier&) override { stateDirty = true; }
+    void valueTreeChildAdded (juce::ValueTree&, juce::ValueTree&) override { stateDirty = true; }
+    void valueTreeChildRemoved (juce::ValueTree&, juce::ValueTree&, int) override { stateDirty = true; }
+    void valueTreeRedirected (juce::ValueTree&) override { stateDirty = true; }
     
     void updateFilters();
     
+    ChainSettings lastChainSettings;
+    bool filtersNeedUpdate = true;
+    
+    void updateAutoGain(bool chainChanged);
+    
+    VersionedSnapshot<ChainSnapshot> chainSnapshot;
+    ChainCoefficients lastPublishedCoefficients {};
+    double lastPublishedSampleRate = 0.0;
+    
+    void publishChain(const ChainCoefficients& chainCoefficients);
+    
+    bool lastAutoGainEnabled = false;
+    AutoGainReference lastAutoGainReference = AutoGainReference::Pink;
+    std::atomic<float> autoGainTarget { 1.f };
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> autoGain;
+    
+    std::unique_ptr<PresetLibrary> presetLibrary;
+    int currentProgram = 0;
+    
+    //swapped under the callback lock, so the audio thread can use it without any other locking
+    std::unique_ptr<MorphTable> morphTable;
+    juce::SmoothedValue<float> morphPosition;
+    
+    void rebuildMorphTable();
+    
+    //the parameters ChainSettings is made of, and whether a morph currently overrides them
+    juce::Array<int> bandParameterIndices;
+    std::atomic<bool> morphing { false };
+    bool restoringState = false;
+    
+    //set from whichever thread a band parameter moved on, acted on by the timer
+    std::atomic<bool> leaveMorphRequested { false };
+    
+    void timerCallback() override;
+    bool updateMorph(int numSamples);
+    
+    std::array<SampleRing, NumAnalyzerTaps> analyzerRings;
+    std::array<int, NumAnalyzerTaps> numAnalyzerClients {};
+    std::atomic<int> enabledAnalyzerTaps { 0 };
+    
+    LevelMeter outputMeter;
+    LevelMeterValues outputLevels;
+    int numMeterClients = 0;
+    std::atomic<bool> metersEnabled { false };
+    
+    GoniometerFeed goniometerFeed;
+    int numGoniometerClients = 0;
+    std::atomic<bool> goniometerEnabled { false };
+    
+    void pushAnalyzerTaps(const juce::AudioBuffer<float>& buffer, int taps, AnalyzerTap leftTap, AnalyzerTap rightTap);
+    
+    //taken on the first createEditor() and kept, so reopening an editor reuses what the last one built
+    std::unique_ptr<juce::SharedResourcePointer<SharedEditorResources>> editorResources;
+    
     
     
     //==============================================================================
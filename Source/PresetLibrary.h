@@ -0,0 +1,305 @@
+/*
+  ==============================================================================
+
+    PresetLibrary.h
+    Fixed size preset records in a single memory mapped file, so browsing and
+    searching never has to parse the presets themselves.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+#include <cctype>
+#include <cstring>
+#include <memory>
+
+/*
+ one preset on disk. written little endian, which is every platform we build for.
+ */
+struct PresetRecord
+{
+    static constexpr int MaxNameLength = 35;
+
+    char name[MaxNameLength + 1];
+    float peakFreq, peakGainDecibels, peakQuality;
+    float highPassFreq, lowPassFreq;
+    juce::uint8 highPassSlope, lowPassSlope;
+    juce::uint8 reserved[6];
+};
+
+static_assert(sizeof(PresetRecord) == 64, "the preset file format relies on 64 byte records");
+
+struct PresetFileHeader
+{
+    static constexpr juce::int32 Magic = 0x5250684a; // "JhPR"
+    static constexpr juce::int32 Version = 1;
+
+    juce::int32 magic, version, numPresets, recordSize;
+};
+
+static_assert(sizeof(PresetFileHeader) == 16, "the preset file format relies on a 16 byte header");
+
+//==============================================================================
+/*
+ every instance in a process maps the same file, and so may instances in other processes.
+ writers take an InterProcessLock and append after the count that's on disk, not the one
+ they happen to have mapped. readers work on a snapshot of the mapping, so a remap on the
+ message thread never pulls the records out from under a host calling getProgramName().
+ */
+struct PresetLibrary
+{
+    PresetLibrary() : PresetLibrary(getDefaultFile()) { }
+
+    explicit PresetLibrary(const juce::File& fileToUse) : file(fileToUse)
+    {
+        map();
+
+        const juce::ScopedLock sl(getInstancesLock());
+        getInstances().add(this);
+    }
+
+    ~PresetLibrary()
+    {
+        const juce::ScopedLock sl(getInstancesLock());
+        getInstances().removeFirstMatchingValue(this);
+    }
+
+    static juce::File getDefaultFile()
+    {
+        return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                .getChildFile("HanStudio")
+                .getChildFile("JhanEQ")
+                .getChildFile("Presets.jhanpresets");
+    }
+
+    //==============================================================================
+    int getNumPresets() const { return getMapping()->numPresets; }
+
+    juce::String getName(int index) const
+    {
+        auto mapping = getMapping();
+
+        if( auto* record = mapping->getRecord(index) )
+            return juce::String::fromUTF8(record->name, (int)strnlen(record->name, PresetRecord::MaxNameLength));
+
+        return {};
+    }
+
+    ChainSettings getSettings(int index) const
+    {
+        ChainSettings settings;
+
+        auto mapping = getMapping();
+
+        if( auto* record = mapping->getRecord(index) )
+        {
+            settings.peakFreq = record->peakFreq;
+            settings.peakGainDecibels = record->peakGainDecibels;
+            settings.peakQuality = record->peakQuality;
+            settings.highPassFreq = record->highPassFreq;
+            settings.lowPassFreq = record->lowPassFreq;
+            settings.highPassSlope = static_cast<Slope>(juce::jlimit<int>(Slope_12, Slope_48, record->highPassSlope));
+            settings.lowPassSlope = static_cast<Slope>(juce::jlimit<int>(Slope_12, Slope_48, record->lowPassSlope));
+        }
+
+        return settings;
+    }
+
+    /*
+     case insensitive (ASCII) substring match run directly over the mapped names.
+     */
+    juce::Array<int> search(const juce::String& text) const
+    {
+        juce::Array<int> matches;
+
+        const auto needle = text.toLowerCase().toStdString();
+
+        auto equalIgnoringCase = [](char a, char b)
+        {
+            return std::tolower((unsigned char)a) == (unsigned char)b;
+        };
+
+        auto mapping = getMapping();
+
+        for( int i = 0; i < mapping->numPresets; ++i )
+        {
+            const auto* name = mapping->records[i].name;
+            const auto* end = name + strnlen(name, PresetRecord::MaxNameLength);
+
+            if( needle.empty() || std::search(name, end, needle.begin(), needle.end(), equalIgnoringCase) != end )
+                matches.add(i);
+        }
+
+        return matches;
+    }
+
+    /*
+     appends a preset and remaps the file in every instance in this process.
+     returns the new index, or -1 if the file couldn't be written.
+     */
+    int addPreset(const juce::String& name, const ChainSettings& settings)
+    {
+        PresetRecord record {};
+        name.copyToUTF8(record.name, PresetRecord::MaxNameLength + 1);
+        record.peakFreq = settings.peakFreq;
+        record.peakGainDecibels = settings.peakGainDecibels;
+        record.peakQuality = settings.peakQuality;
+        record.highPassFreq = settings.highPassFreq;
+        record.lowPassFreq = settings.lowPassFreq;
+        record.highPassSlope = (juce::uint8)settings.highPassSlope;
+        record.lowPassSlope = (juce::uint8)settings.lowPassSlope;
+
+        juce::InterProcessLock writerLock("JhanEQPresetLibrary");
+        const juce::InterProcessLock::ScopedLockType ipl(writerLock);
+
+        if( ! ipl.isLocked() )
+            return -1;
+
+        //whatever another instance appended since we mapped the file counts, not our snapshot
+        auto newIndex = readNumPresetsOnDisk();
+
+        if( newIndex < 0 )
+        {
+            file.deleteFile();
+            file.getParentDirectory().createDirectory();
+            newIndex = 0;
+        }
+
+        //only appends past the end and rewrites the header, which no mapping gets in the way of
+        {
+            juce::FileOutputStream out(file);
+            if( ! out.openedOk() )
+                return -1;
+
+            PresetFileHeader header { PresetFileHeader::Magic, PresetFileHeader::Version, newIndex + 1, (juce::int32)sizeof(PresetRecord) };
+
+            out.setPosition(sizeof(PresetFileHeader) + (juce::int64)newIndex * (juce::int64)sizeof(PresetRecord));
+            out.write(&record, sizeof(record));
+
+            out.setPosition(0);
+            out.write(&header, sizeof(header));
+            out.flush();
+
+            if( out.getStatus().failed() )
+                return -1;
+        }
+
+        {
+            const juce::ScopedLock sl(getInstancesLock());
+
+            for( auto* library : getInstances() )
+            {
+                if( library->file == file )
+                    library->map();
+            }
+        }
+
+        return getNumPresets() > newIndex ? newIndex : -1;
+    }
+private:
+    struct Mapping
+    {
+        std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+        const PresetRecord* records = nullptr;
+        int numPresets = 0;
+
+        const PresetRecord* getRecord(int index) const
+        {
+            return juce::isPositiveAndBelow(index, numPresets) ? records + index : nullptr;
+        }
+    };
+
+    juce::File file;
+
+    std::shared_ptr<const Mapping> mapping { std::make_shared<Mapping>() };
+    mutable juce::SpinLock mappingLock;
+
+    std::shared_ptr<const Mapping> getMapping() const
+    {
+        const juce::SpinLock::ScopedLockType sl(mappingLock);
+        return mapping;
+    }
+
+    static bool isValid(const PresetFileHeader& header)
+    {
+        return header.magic == PresetFileHeader::Magic
+            && header.version <= PresetFileHeader::Version
+            && header.recordSize == (juce::int32)sizeof(PresetRecord);
+    }
+
+    //never trust the count further than the file actually goes
+    static int getUsableCount(const PresetFileHeader& header, juce::int64 fileSize)
+    {
+        auto available = (fileSize - (juce::int64)sizeof(PresetFileHeader)) / (juce::int64)sizeof(PresetRecord);
+        return (int)juce::jmin((juce::int64)juce::jmax(0, header.numPresets), available);
+    }
+
+    /*
+     the count straight from the file, or -1 if there's no usable file to append to.
+     */
+    int readNumPresetsOnDisk() const
+    {
+        juce::FileInputStream in(file);
+
+        PresetFileHeader header;
+        if( ! in.openedOk() || in.read(&header, sizeof(header)) != (int)sizeof(header) || ! isValid(header) )
+            return -1;
+
+        return getUsableCount(header, in.getTotalLength());
+    }
+
+    /*
+     builds the new mapping completely before swapping it in.
+     */
+    void map()
+    {
+        auto newMapping = std::make_shared<Mapping>();
+
+        if( file.existsAsFile() )
+        {
+            auto mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+
+            auto* data = static_cast<const char*>(mappedFile->getData());
+            auto size = (juce::int64)mappedFile->getSize();
+
+            PresetFileHeader header;
+
+            if( data != nullptr && size >= (juce::int64)sizeof(PresetFileHeader) )
+            {
+                std::memcpy(&header, data, sizeof(header));
+
+                if( isValid(header) )
+                {
+                    newMapping->numPresets = getUsableCount(header, size);
+                    newMapping->records = reinterpret_cast<const PresetRecord*>(data + sizeof(PresetFileHeader));
+                    newMapping->mappedFile = std::move(mappedFile);
+                }
+            }
+        }
+
+        std::shared_ptr<const Mapping> oldMapping(std::move(newMapping));
+
+        {
+            const juce::SpinLock::ScopedLockType sl(mappingLock);
+            std::swap(mapping, oldMapping);
+        }
+
+        //the old mapping goes when the last reader lets go of it, outside the lock
+    }
+
+    static juce::Array<PresetLibrary*>& getInstances()
+    {
+        static juce::Array<PresetLibrary*> instances;
+        return instances;
+    }
+
+    static juce::CriticalSection& getInstancesLock()
+    {
+        static juce::CriticalSection lock;
+        return lock;
+    }
+};
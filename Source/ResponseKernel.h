@@ -0,0 +1,254 @@
+/*
+  ==============================================================================
+
+    ResponseKernel.h
+    Magnitude response of a cascade of biquads at every column of the response curve.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+/*
+ the columns sit at fixed frequencies, so z^-1 and z^-2 for each of them are worked
+ out once, when the width or the sample rate changes. after that a section is
+ a handful of multiply-adds and one divide per column:
+
+     |H|^2 = |b0 + b1 z^-1 + b2 z^-2|^2 / |1 + a1 z^-1 + a2 z^-2|^2
+
+ run as one straight pass over all the columns, which the compiler vectorizes.
+ the product over the sections turns into decibels with a single log per column.
+
+ the coarse grid is every coarseStep'th column (and the last one) with its own
+ tables, for redrawing while a slider is being dragged.
+
+ phase and group delay come from the same tables and are worked out per section
+ analytically, in passes of the same shape, only when they're asked for.
+ */
+struct ResponseKernel
+{
+    //b0, b1, b2, a1, a2, already divided by a0
+    using Section = std::array<float, 5>;
+
+    static constexpr int coarseStep = 4;
+
+    /*
+     columns are spaced logarithmically from minFrequency at column 0 to maxFrequency
+     at column numColumns. not real time safe.
+     */
+    void setColumns(int numColumns, double sampleRate, double minFrequency, double maxFrequency)
+    {
+        constexpr auto twoPi = 2.0 * 3.14159265358979323846;
+
+        width = std::max(0, numColumns);
+        rate = sampleRate;
+
+        for( int g = 0; g < 2; ++g )
+        {
+            auto& grid = grids[g];
+            const auto step = g == 0 ? 1 : coarseStep;
+
+            grid.columns.clear();
+
+            for( int x = 0; x < width; x += step )
+                grid.columns.push_back(x);
+
+            if( width > 0 && grid.columns.back() != width - 1 )
+                grid.columns.push_back(width - 1);
+
+            const auto size = grid.columns.size();
+            grid.cos1.resize(size);
+            grid.sin1.resize(size);
+            grid.cos2.resize(size);
+            grid.sin2.resize(size);
+
+            for( size_t i = 0; i < size; ++i )
+            {
+                const auto frequency = minFrequency * std::pow(maxFrequency / minFrequency, double(grid.columns[i]) / double(std::max(1, width)));
+                const auto omega = twoPi * frequency / sampleRate;
+
+                grid.cos1[i] = std::cos(omega);
+                grid.sin1[i] = std::sin(omega);
+                grid.cos2[i] = std::cos(2.0 * omega);
+                grid.sin2[i] = std::sin(2.0 * omega);
+            }
+
+            grid.power.resize(size);
+            grid.decibels.resize(size);
+            grid.phaseRe.resize(size);
+            grid.phaseIm.resize(size);
+            grid.phase.resize(size);
+            grid.delay.resize(size);
+            grid.groupDelay.resize(size);
+        }
+    }
+
+    bool matches(int numColumns, double sampleRate) const { return numColumns == width && sampleRate == rate; }
+
+    //what process() works out besides the magnitude, as bit flags
+    enum Curves
+    {
+        Phase = 1,
+        GroupDelay = 2
+    };
+
+    struct Points
+    {
+        const int* columns = nullptr;
+        const float* decibels = nullptr;
+        const float* phase = nullptr; //radians, unwrapped, only with Phase
+        const float* groupDelay = nullptr; //milliseconds, only with GroupDelay
+        int size = 0;
+    };
+
+    /*
+     the response of all the sections in series, in decibels, at every column or at the coarse ones.
+     'curves' adds the phase and / or group delay. the results stay valid until the next call.
+     */
+    Points process(const Section* sections, int numSections, bool coarse, int curves = 0)
+    {
+        auto& grid = grids[coarse ? 1 : 0];
+        const auto size = (int)grid.columns.size();
+
+        auto* power = grid.power.data();
+        auto* phaseRe = grid.phaseRe.data();
+        auto* phaseIm = grid.phaseIm.data();
+        auto* delay = grid.delay.data();
+        const auto* c1 = grid.cos1.data();
+        const auto* s1 = grid.sin1.data();
+        const auto* c2 = grid.cos2.data();
+        const auto* s2 = grid.sin2.data();
+
+        std::fill(power, power + size, 1.0);
+        std::fill(phaseRe, phaseRe + size, 1.0);
+        std::fill(phaseIm, phaseIm + size, 0.0);
+        std::fill(delay, delay + size, 0.0);
+
+        for( int s = 0; s < numSections; ++s )
+        {
+            const double b0 = sections[s][0], b1 = sections[s][1], b2 = sections[s][2];
+            const double a1 = sections[s][3], a2 = sections[s][4];
+
+            if( curves == 0 )
+            {
+                //z^-n = cos(n w) - j sin(n w), the sign of the imaginary parts doesn't change the magnitude
+                for( int i = 0; i < size; ++i )
+                {
+                    const auto numeratorRe = b0 + b1 * c1[i] + b2 * c2[i];
+                    const auto numeratorIm = b1 * s1[i] + b2 * s2[i];
+                    const auto denominatorRe = 1.0 + a1 * c1[i] + a2 * c2[i];
+                    const auto denominatorIm = a1 * s1[i] + a2 * s2[i];
+
+                    power[i] *= (numeratorRe * numeratorRe + numeratorIm * numeratorIm)
+                                / (denominatorRe * denominatorRe + denominatorIm * denominatorIm);
+                }
+
+                continue;
+            }
+
+            //with phase or delay asked for, all three come out of the same pass: it's the
+            //loads and the shared products that cost, not the extra arithmetic
+            for( int i = 0; i < size; ++i )
+            {
+                const auto numeratorRe = b0 + b1 * c1[i] + b2 * c2[i];
+                const auto numeratorIm = -(b1 * s1[i] + b2 * s2[i]);
+                const auto denominatorRe = 1.0 + a1 * c1[i] + a2 * c2[i];
+                const auto denominatorIm = -(a1 * s1[i] + a2 * s2[i]);
+
+                const auto numeratorPower = std::max(numeratorRe * numeratorRe + numeratorIm * numeratorIm, 1.0e-30);
+                const auto denominatorPower = denominatorRe * denominatorRe + denominatorIm * denominatorIm;
+
+                power[i] *= numeratorPower / denominatorPower;
+
+                //the phase of N / D is the phase of N * conj(D). the product over the sections
+                //is kept as a complex number, so there's one atan2 per column at the end
+                const auto re = numeratorRe * denominatorRe + numeratorIm * denominatorIm;
+                const auto im = numeratorIm * denominatorRe - numeratorRe * denominatorIm;
+
+                const auto productRe = phaseRe[i] * re - phaseIm[i] * im;
+                phaseIm[i] = phaseRe[i] * im + phaseIm[i] * re;
+                phaseRe[i] = productRe;
+
+                //for P = sum p_k z^-k the delay is Re(sum k p_k z^-k / P) samples,
+                //a section's is its numerator's minus its denominator's
+                const auto numeratorSlopeRe = b1 * c1[i] + 2.0 * b2 * c2[i];
+                const auto numeratorSlopeIm = -(b1 * s1[i] + 2.0 * b2 * s2[i]);
+                const auto denominatorSlopeRe = a1 * c1[i] + 2.0 * a2 * c2[i];
+                const auto denominatorSlopeIm = -(a1 * s1[i] + 2.0 * a2 * s2[i]);
+
+                delay[i] += (numeratorSlopeRe * numeratorRe + numeratorSlopeIm * numeratorIm) / numeratorPower
+                            - (denominatorSlopeRe * denominatorRe + denominatorSlopeIm * denominatorIm) / denominatorPower;
+            }
+        }
+
+        //10 log10 of the power is 20 log10 of the magnitude, floored at -200 dB
+        auto* decibels = grid.decibels.data();
+
+        for( int i = 0; i < size; ++i )
+            decibels[i] = float(10.0 * std::log10(std::max(power[i], 1.0e-20)));
+
+        Points points { grid.columns.data(), decibels, nullptr, nullptr, size };
+
+        if( (curves & Phase) && size > 0 )
+        {
+            unwrapPhase(grid);
+            points.phase = grid.phase.data();
+        }
+
+        if( curves & GroupDelay )
+        {
+            const auto toMilliseconds = 1000.0 / rate;
+
+            for( int i = 0; i < size; ++i )
+                grid.groupDelay[(size_t)i] = float(delay[i] * toMilliseconds);
+
+            points.groupDelay = grid.groupDelay.data();
+        }
+
+        return points;
+    }
+private:
+    struct Grid
+    {
+        std::vector<int> columns;
+        std::vector<double> cos1, sin1, cos2, sin2;
+        std::vector<double> power;
+        std::vector<float> decibels;
+
+        std::vector<double> phaseRe, phaseIm, delay;
+        std::vector<float> phase, groupDelay;
+    };
+
+    std::array<Grid, 2> grids;
+    int width = 0;
+    double rate = 0.0;
+
+    /*
+     the product only knows the phase modulo 2 pi. neighbouring columns are close enough
+     together to unwrap it, starting from the principal value at the first column, so
+     a flat band reads 0 rather than some multiple of 360 degrees.
+     */
+    static void unwrapPhase(Grid& grid)
+    {
+        constexpr auto pi = 3.14159265358979323846;
+        const auto size = grid.columns.size();
+
+        auto previous = std::atan2(grid.phaseIm[0], grid.phaseRe[0]);
+        auto unwrapped = previous;
+        grid.phase[0] = float(unwrapped);
+
+        for( size_t i = 1; i < size; ++i )
+        {
+            const auto wrapped = std::atan2(grid.phaseIm[i], grid.phaseRe[i]);
+            unwrapped += std::remainder(wrapped - previous, 2.0 * pi);
+            previous = wrapped;
+
+            grid.phase[i] = float(unwrapped);
+        }
+    }
+};
@@ -0,0 +1,211 @@
+/*
+  ==============================================================================
+
+    SampleRing.h
+    Single producer / single consumer ring of samples for the analyzer taps.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ the audio thread pushes whole blocks with at most two memcpy's and never waits.
+ the consumer keeps its own read position and can copy (or look at) any window
+ that is still in the ring, addressed by absolute sample position.
+
+ the producer never blocks on the consumer: if the consumer falls more than a
+ ring behind, the samples it missed are skipped and counted as overflow.
+ */
+struct SampleRing
+{
+    using Position = std::int64_t;
+
+    /*
+     not thread safe, call while neither side is running.
+     the capacity is rounded up to a power of two.
+     */
+    void prepare(int minimumCapacity)
+    {
+        int capacity = 1;
+        while( capacity < minimumCapacity )
+            capacity <<= 1;
+
+        buffer.assign((size_t)capacity, 0.f);
+        mask = capacity - 1;
+
+        writePosition.store(0);
+        writeEnd.store(0);
+        readPosition = 0;
+        numOverflowed.store(0);
+    }
+
+    void release()
+    {
+        buffer = std::vector<float>();
+        mask = -1;
+        writePosition.store(0);
+        writeEnd.store(0);
+        readPosition = 0;
+    }
+
+    /*
+     not thread safe either. lines this ring's positions up with another's, so
+     windows at the same position in both hold the same moment.
+     */
+    void setWritePosition(Position position)
+    {
+        writePosition.store(position);
+        writeEnd.store(position);
+        readPosition = position;
+    }
+
+    int getCapacity() const { return mask + 1; }
+    bool isPrepared() const { return mask >= 0; }
+
+    //==============================================================================
+    // producer
+
+    void push(const float* samples, int numSamples)
+    {
+        if( numSamples <= 0 || ! isPrepared() )
+            return;
+
+        const auto capacity = getCapacity();
+        const auto start = writePosition.load(std::memory_order_relaxed);
+
+        //tell readers which region is about to change before touching it
+        writeEnd.store(start + numSamples, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        //a block bigger than the ring only leaves its tail behind
+        auto skipped = std::max(0, numSamples - capacity);
+        auto toWrite = numSamples - skipped;
+        auto first = start + skipped;
+
+        auto index = (int)(first & mask);
+        auto size1 = std::min(toWrite, capacity - index);
+
+        std::memcpy(buffer.data() + index, samples + skipped, sizeof(float) * (size_t)size1);
+        std::memcpy(buffer.data(), samples + skipped + size1, sizeof(float) * (size_t)(toWrite - size1));
+
+        writePosition.store(start + numSamples, std::memory_order_release);
+    }
+
+    //==============================================================================
+    // consumer
+
+    /*
+     total number of samples pushed so far. everything before this is readable,
+     as long as it is no more than a ring behind.
+     */
+    Position getWritePosition() const { return writePosition.load(std::memory_order_acquire); }
+
+    /*
+     copies numSamples starting at the absolute position 'start'.
+     positions before the first pushed sample read as silence.
+     returns false if the producer overwrote any of the window while we copied it.
+     */
+    bool copy(Position start, int numSamples, float* dest) const
+    {
+        if( ! isPrepared() )
+            return false;
+
+        if( start < 0 )
+        {
+            auto silent = (int)std::min<Position>(-start, numSamples);
+            std::fill(dest, dest + silent, 0.f);
+            dest += silent;
+            numSamples -= silent;
+            start = 0;
+        }
+
+        if( numSamples <= 0 )
+            return true;
+
+        auto region = getRegion(start, numSamples);
+        std::memcpy(dest, region.data1, sizeof(float) * (size_t)region.size1);
+        std::memcpy(dest + region.size1, region.data2, sizeof(float) * (size_t)region.size2);
+
+        return isStillValid(start);
+    }
+
+    /*
+     the same window as (up to) two contiguous pieces straight out of the ring, no copying.
+     check isStillValid() after using them.
+     */
+    struct Region
+    {
+        const float* data1 = nullptr;
+        int size1 = 0;
+        const float* data2 = nullptr;
+        int size2 = 0;
+    };
+
+    Region getRegion(Position start, int numSamples) const
+    {
+        Region region;
+
+        if( ! isPrepared() || start < 0 )
+            return region;
+
+        numSamples = std::min(numSamples, getCapacity());
+
+        auto index = (int)(start & mask);
+        region.data1 = buffer.data() + index;
+        region.size1 = std::min(numSamples, getCapacity() - index);
+        region.data2 = buffer.data();
+        region.size2 = numSamples - region.size1;
+
+        return region;
+    }
+
+    /*
+     true if nothing from 'start' onwards has been (or is being) overwritten.
+     */
+    bool isStillValid(Position start) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return start >= writeEnd.load(std::memory_order_relaxed) - getCapacity();
+    }
+
+    /*
+     samples pushed since the consumer last advanced. if we fell more than a ring
+     behind, the read position jumps forward and the gap is counted as overflow.
+     */
+    int getNumUnread()
+    {
+        auto write = getWritePosition();
+
+        //keep a quarter of the ring clear of whatever the producer writes next
+        auto oldestSafe = write - (Position)(getCapacity() - getCapacity() / 4);
+        if( readPosition < oldestSafe )
+        {
+            numOverflowed.fetch_add(oldestSafe - readPosition, std::memory_order_relaxed);
+            readPosition = oldestSafe;
+        }
+
+        return (int)(write - readPosition);
+    }
+
+    Position getReadPosition() const { return readPosition; }
+    void advance(int numSamples) { readPosition += numSamples; }
+
+    /*
+     samples the consumer never got to because it fell behind. safe to read from any thread.
+     */
+    Position getNumOverflowedSamples() const { return numOverflowed.load(std::memory_order_relaxed); }
+private:
+    std::vector<float> buffer;
+    int mask = -1;
+
+    std::atomic<Position> writePosition { 0 }, writeEnd { 0 };
+    Position readPosition = 0;
+    std::atomic<Position> numOverflowed { 0 };
+};
@@ -0,0 +1,165 @@
+/*
+  ==============================================================================
+
+    SpectrumKernel.h
+    Everything that happens to the analyzer's bins after the FFT, in one pass.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ normalization, dB conversion, exponential averaging and peak-hold with decay are
+ fused into a single loop over the bins. the loop body is branch free (selects
+ only, no calls), so the compiler vectorizes it.
+
+ the averages and peaks are always kept up to date, whichever mode is showing,
+ so switching modes never starts from silence.
+ */
+struct SpectrumKernel
+{
+    enum class Mode
+    {
+        Instant,
+        Average,
+        PeakHold
+    };
+
+    void prepare(int maxNumBins)
+    {
+        average.assign((size_t)maxNumBins, 0.f);
+        peak.assign((size_t)maxNumBins, 0.f);
+        needsReset = true;
+    }
+
+    /*
+     the averages restart from the next frame, e.g. after the bins changed meaning.
+     */
+    void reset() { needsReset = true; }
+
+    /*
+     magnitudes -> decibels, numBins of each. 'scale' normalizes the magnitudes,
+     anything below floorDecibels (including NaN and inf) comes out as floorDecibels.
+     averageCoefficient is the one pole coefficient for this frame (1 = no averaging),
+     peakDecayDecibels is how far the held peaks fall this frame.
+     */
+    void process(const float* magnitudes, float* decibels, int numBins,
+                 float scale, float floorDecibels, Mode mode,
+                 float averageCoefficient, float peakDecayDecibels)
+    {
+        numBins = std::min(numBins, (int)average.size());
+
+        if( needsReset )
+        {
+            std::fill(average.begin(), average.begin() + numBins, floorDecibels);
+            std::fill(peak.begin(), peak.begin() + numBins, floorDecibels);
+            averageCoefficient = 1.f;
+            needsReset = false;
+        }
+
+        switch( mode )
+        {
+            case Mode::Instant:  run<Mode::Instant>(magnitudes, decibels, numBins, scale, floorDecibels, averageCoefficient, peakDecayDecibels); break;
+            case Mode::Average:  run<Mode::Average>(magnitudes, decibels, numBins, scale, floorDecibels, averageCoefficient, peakDecayDecibels); break;
+            case Mode::PeakHold: run<Mode::PeakHold>(magnitudes, decibels, numBins, scale, floorDecibels, averageCoefficient, peakDecayDecibels); break;
+        }
+    }
+
+    /*
+     20 * log10(x) for finite x > 0, from the float's exponent plus an odd series on
+     the mantissa. the error stays below 1e-4 dB over the whole float range.
+     */
+    static inline float fastGainToDecibels(float x)
+    {
+        std::int32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return decibelsFromBits(bits);
+    }
+private:
+    std::vector<float> average, peak;
+    bool needsReset = true;
+
+    /*
+     all the decisions are made on the integer bits: float compares and selects can
+     trap, so compilers won't vectorize them unless told to ignore that.
+     */
+    static inline float decibelsFromBits(std::int32_t bits)
+    {
+        //split into 2^e * m with m in [sqrt(0.5), sqrt(2))
+        std::int32_t mantissaBits = (bits & 0x007fffff) | 0x3f800000;
+        const std::int32_t high = mantissaBits > 0x3fb504f3 ? 1 : 0; // sqrt(2)
+        mantissaBits -= high << 23;
+
+        const auto e = float(((bits >> 23) & 0xff) - 127 + high);
+
+        float m;
+        std::memcpy(&m, &mantissaBits, sizeof(m));
+
+        //ln(m) = 2 atanh(s), |s| < 0.172
+        const auto s = (m - 1.f) / (m + 1.f);
+        const auto s2 = s * s;
+        const auto lnM = 2.f * s * (1.f + s2 * (1.f / 3.f + s2 * (1.f / 5.f + s2 * (1.f / 7.f))));
+
+        //20 log10(2) and 20 log10(e)
+        return 6.02059991f * e + 8.68588964f * lnM;
+    }
+
+    static inline std::int32_t toBits(float x)
+    {
+        std::int32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return bits;
+    }
+
+    //maps float bits to an int that orders like the float does, negatives included
+    static inline std::int32_t orderedBits(float x)
+    {
+        const auto bits = toBits(x);
+        return bits ^ ((bits >> 31) & 0x7fffffff);
+    }
+
+    static inline float fromBits(std::int32_t bits)
+    {
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        return x;
+    }
+
+    template<Mode mode>
+    void run(const float* magnitudes, float* decibels, int numBins,
+             float scale, float floorDecibels, float averageCoefficient, float peakDecayDecibels)
+    {
+        //anything that would map below the floor is clamped before the log, which also keeps it away from 0 and denormals
+        const auto floorBits = toBits(std::max(1.0e-30f, std::pow(10.f, floorDecibels * 0.05f)));
+        const auto maxBits = toBits(3.0e38f);
+
+        auto* avg = average.data();
+        auto* pk = peak.data();
+
+        for( int i = 0; i < numBins; ++i )
+        {
+            //non negative floats order the same as their bits. NaN, inf and negatives all land on the floor
+            auto bits = toBits(magnitudes[i] * scale);
+            const std::int32_t inRange = -std::int32_t((bits >= floorBits) & (bits <= maxBits));
+            bits = (bits & inRange) | (floorBits & ~inRange);
+
+            const auto db = decibelsFromBits(bits);
+
+            const auto a = avg[i] + averageCoefficient * (db - avg[i]);
+            //the larger of two floats, compared as ordered integers (dB values are finite)
+            const auto decayed = pk[i] - peakDecayDecibels;
+            const auto p = fromBits(orderedBits(db) > orderedBits(decayed) ? toBits(db) : toBits(decayed));
+            avg[i] = a;
+            pk[i] = p;
+
+            decibels[i] = mode == Mode::Average ? a : mode == Mode::PeakHold ? p : db;
+        }
+    }
+};
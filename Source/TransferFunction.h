@@ -0,0 +1,181 @@
+/*
+  ==============================================================================
+
+    TransferFunction.h
+    Measured transfer function and coherence between the analyzer's pre and post taps.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+/*
+ x is the input and y the output. every frame adds to running averages of the
+ auto spectra Sxx, Syy and the cross spectrum Sxy, from which
+
+     H = Sxy / Sxx                  coherence = |Sxy|^2 / (Sxx Syy)
+
+ the averages are exponential, so the memory is one set of bins whatever the
+ running time. a column of the display sums the spectra over its bins before
+ dividing, which is the usual way of smoothing a measured response: bins with
+ little input energy count for little.
+
+ coherence is 1 where y is a linear function of x and falls towards 0 where
+ there's noise, nonlinearity, or not enough input to tell.
+ */
+struct TransferFunction
+{
+    using Complex = std::complex<float>;
+
+    static constexpr double averageSeconds = 1.0;
+
+    /*
+     one frame always has a coherence of exactly 1, whatever the signals, so until this
+     many have gone into the averages the coherence reads 0.
+     */
+    static constexpr int minFramesForCoherence = 8;
+
+    /*
+     not real time safe.
+     */
+    void prepare(int maxNumBins)
+    {
+        sxx.assign((size_t)maxNumBins, 0.0);
+        syy.assign((size_t)maxNumBins, 0.0);
+        sxyRe.assign((size_t)maxNumBins, 0.0);
+        sxyIm.assign((size_t)maxNumBins, 0.0);
+        numBins = 0;
+        numFrames = 0;
+    }
+
+    void reset()
+    {
+        numBins = 0;
+        numFrames = 0;
+    }
+
+    /*
+     adds one frame. 'packed' is the complex FFT of x + j y, fftSize of it, so both
+     spectra come out of one FFT. averageCoefficient is the one pole coefficient for
+     this frame. a new FFT size starts the averages over.
+     */
+    void addFrame(const Complex* packed, int fftSize, float averageCoefficient)
+    {
+        const auto newNumBins = std::min(fftSize / 2, (int)sxx.size());
+
+        if( newNumBins != numBins )
+        {
+            std::fill(sxx.begin(), sxx.end(), 0.0);
+            std::fill(syy.begin(), syy.end(), 0.0);
+            std::fill(sxyRe.begin(), sxyRe.end(), 0.0);
+            std::fill(sxyIm.begin(), sxyIm.end(), 0.0);
+
+            numBins = newNumBins;
+            numFrames = 0;
+            averageCoefficient = 1.f;
+        }
+
+        numFrames = std::min(numFrames + 1, minFramesForCoherence);
+
+        const double c = averageCoefficient;
+        const auto mask = fftSize - 1;
+
+        for( int k = 0; k < numBins; ++k )
+        {
+            //X = (Z[k] + Z*[N-k]) / 2, Y = (Z[k] - Z*[N-k]) / 2j. the 1/2s cancel in H and the coherence
+            const auto z = packed[k];
+            const auto w = packed[(fftSize - k) & mask];
+
+            const double xRe = z.real() + w.real(), xIm = z.imag() - w.imag();
+            const double yRe = z.imag() + w.imag(), yIm = w.real() - z.real();
+
+            sxx[(size_t)k] += c * (xRe * xRe + xIm * xIm - sxx[(size_t)k]);
+            syy[(size_t)k] += c * (yRe * yRe + yIm * yIm - syy[(size_t)k]);
+
+            //conj(X) Y
+            sxyRe[(size_t)k] += c * (xRe * yRe + xIm * yIm - sxyRe[(size_t)k]);
+            sxyIm[(size_t)k] += c * (xRe * yIm - xIm * yRe - sxyIm[(size_t)k]);
+        }
+    }
+
+    /*
+     the bins each of numColumns columns covers, log spaced from minFrequency to
+     maxFrequency. only does any work when something changed.
+     */
+    void setColumns(int numColumns, double binWidth, double minFrequency, double maxFrequency)
+    {
+        if( numColumns == columnCount && binWidth == columnBinWidth && numBins == columnNumBins )
+            return;
+
+        columnCount = numColumns;
+        columnBinWidth = binWidth;
+        columnNumBins = numBins;
+        columns.resize((size_t)std::max(0, numColumns));
+
+        const auto lastBin = std::max(1, numBins - 1);
+
+        for( int x = 0; x < numColumns; ++x )
+        {
+            auto frequencyAt = [&](double position) { return minFrequency * std::pow(maxFrequency / minFrequency, position / numColumns); };
+
+            //every column gets at least the bin nearest its centre
+            auto start = std::min(lastBin, (int)std::floor(frequencyAt(x) / binWidth + 0.5));
+            auto end = std::min(lastBin + 1, (int)std::floor(frequencyAt(x + 1) / binWidth + 0.5));
+
+            columns[(size_t)x] = { std::max(1, start), std::max(std::max(1, start) + 1, end) };
+        }
+    }
+
+    /*
+     |H| in decibels and the coherence for every column. columns without any input
+     energy read floorDecibels with a coherence of 0, and so does every column's
+     coherence until minFramesForCoherence frames have been averaged.
+     */
+    void getColumns(float* decibels, float* coherence, float floorDecibels) const
+    {
+        for( int x = 0; x < columnCount; ++x )
+        {
+            double inputPower = 0.0, outputPower = 0.0, crossRe = 0.0, crossIm = 0.0;
+
+            for( int k = columns[(size_t)x].start; k < columns[(size_t)x].end; ++k )
+            {
+                inputPower += sxx[(size_t)k];
+                outputPower += syy[(size_t)k];
+                crossRe += sxyRe[(size_t)k];
+                crossIm += sxyIm[(size_t)k];
+            }
+
+            const auto crossPower = crossRe * crossRe + crossIm * crossIm;
+
+            if( numBins == 0 || inputPower <= 1.0e-20 || outputPower <= 1.0e-20 )
+            {
+                decibels[x] = floorDecibels;
+                coherence[x] = 0.f;
+                continue;
+            }
+
+            //|H|^2 = |Sxy|^2 / Sxx^2
+            decibels[x] = std::max(floorDecibels, float(10.0 * std::log10(std::max(crossPower, 1.0e-30) / (inputPower * inputPower))));
+            coherence[x] = numFrames < minFramesForCoherence ? 0.f : (float)std::min(1.0, crossPower / (inputPower * outputPower));
+        }
+    }
+
+    int getNumColumns() const { return columnCount; }
+private:
+    std::vector<double> sxx, syy, sxyRe, sxyIm;
+    int numBins = 0, numFrames = 0;
+
+    struct Span
+    {
+        int start = 0, end = 0;
+    };
+
+    std::vector<Span> columns;
+    int columnCount = 0, columnNumBins = 0;
+    double columnBinWidth = 0.0;
+};
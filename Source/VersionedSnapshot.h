@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    VersionedSnapshot.h
+    Lock-free, versioned copy of a value the audio thread publishes for the editor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ a sequence lock. one writer publishes, any number of readers copy the value out,
+ and neither ever waits on the other: the writer makes the sequence number odd
+ while it writes and even again when it's done, and a reader that saw an odd
+ number, or a different one after copying, just tries again.
+
+ the value is kept as atomic words so a reader racing the writer reads a torn
+ copy (which it then throws away) rather than causing undefined behaviour.
+
+ the version is the number of publishes so far, 0 means nothing was published yet.
+ */
+template<typename ValueType>
+struct VersionedSnapshot
+{
+    static_assert( std::is_trivially_copyable<ValueType>::value, "the value is copied as raw words" );
+
+    using Version = std::uint32_t;
+
+    /*
+     writer only. never blocks.
+     */
+    void publish(const ValueType& value)
+    {
+        std::array<std::uint32_t, numWords> source {};
+        std::memcpy(source.data(), &value, sizeof(ValueType));
+
+        const auto sequence = sequenceNumber.load(std::memory_order_relaxed);
+        sequenceNumber.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for( size_t i = 0; i < numWords; ++i )
+            words[i].store(source[i], std::memory_order_relaxed);
+
+        sequenceNumber.store(sequence + 2, std::memory_order_release);
+    }
+
+    Version getVersion() const { return sequenceNumber.load(std::memory_order_acquire) / 2; }
+
+    /*
+     copies the value into dest if it's newer than knownVersion and updates knownVersion.
+     returns false if there's nothing newer, or if the writer kept getting in the way,
+     in which case the next call picks it up.
+     */
+    bool readIfNewer(ValueType& dest, Version& knownVersion) const
+    {
+        for( int attempt = 0; attempt < maxAttempts; ++attempt )
+        {
+            const auto before = sequenceNumber.load(std::memory_order_acquire);
+
+            if( before / 2 == knownVersion && (before & 1) == 0 )
+                return false;
+
+            if( before & 1 )
+                continue;
+
+            std::array<std::uint32_t, numWords> copy;
+
+            for( size_t i = 0; i < numWords; ++i )
+                copy[i] = words[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if( sequenceNumber.load(std::memory_order_relaxed) != before )
+                continue;
+
+            std::memcpy(&dest, copy.data(), sizeof(ValueType));
+            knownVersion = before / 2;
+            return true;
+        }
+
+        return false;
+    }
+private:
+    static constexpr size_t numWords = (sizeof(ValueType) + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t);
+    static constexpr int maxAttempts = 16;
+
+    std::array<std::atomic<std::uint32_t>, numWords> words {};
+    std::atomic<std::uint32_t> sequenceNumber { 0 };
+};